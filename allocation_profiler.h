@@ -0,0 +1,409 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_ALLOCATION_PROFILER_H
+#define FASTPATH_ALLOCATION_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <limits>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
+#include "optimize.h"
+
+namespace tf {
+
+    // A sampling profiler for the arenas, after tcmalloc's heap sampler. Each thread
+    // counts down the bytes it allocates and records the call stack of the
+    // allocation that takes the count below zero, then draws the next count from
+    // an exponential distribution with the mean sample rate, so on average one
+    // sample is taken per sample_rate bytes whatever the mix of sizes, and every
+    // byte has the same chance of being the one sampled. Samples are grouped by
+    // arena and call stack into sites, each scaled up to an estimate of the bytes
+    // and blocks it stands for, with a histogram of block sizes and, once they are
+    // freed, of how long its blocks lived.
+    //
+    // While stopped, the hook in allocate costs a subtraction and a branch, and once
+    // every disabled_interval bytes a look at whether sampling has been started; the
+    // hook in deallocate is one load while no sampled block is live.
+    //
+    //   tf::allocation_profiler::start(512 * 1024);
+    //   ...
+    //   std::ofstream out("arena.folded");
+    //   tf::allocation_profiler::write_folded(out, tf::allocation_profiler::live_bytes);
+    //
+    // and then flamegraph.pl arena.folded > arena.svg. Frames without a dynamic
+    // symbol (anything in an executable not linked with -rdynamic) are written as
+    // module+0xoffset, for addr2line.
+    template <typename Tag = void> class basic_allocation_profiler {
+    public:
+        // what write_folded weights each stack by
+        enum metric {
+            allocated_bytes,    // every byte allocated since the profile was last reset
+            allocated_blocks,
+            live_bytes,         // bytes allocated and not yet freed
+            live_blocks
+        };
+
+        static constexpr std::size_t max_frames = 64;
+        static constexpr std::size_t histogram_buckets = 48;
+
+    private:
+        static constexpr std::int64_t disabled_interval = 1024 * 1024;
+        static constexpr std::size_t filter_size = 4096;
+
+        struct site {
+            const void *m_arena;
+            std::vector<void *> m_frames;
+            double m_allocated_bytes;
+            double m_allocated_blocks;
+            double m_live_bytes;
+            double m_live_blocks;
+            // power of two buckets, of block size in bytes and of lifetime in microseconds
+            std::uint64_t m_sizes[histogram_buckets];
+            std::uint64_t m_lifetimes[histogram_buckets];
+        };
+
+        struct sample {
+            std::size_t m_site;
+            double m_bytes;
+            double m_blocks;
+            std::chrono::steady_clock::time_point m_allocated;
+        };
+
+        struct state {
+            std::mutex m_lock;
+            std::vector<site> m_sites;
+            std::unordered_map<std::size_t, std::vector<std::size_t>> m_sites_by_hash;
+            std::unordered_map<const void *, sample> m_live;
+            std::unordered_map<const void *, std::string> m_arena_names;
+        };
+
+        static std::atomic<std::size_t> s_sample_rate;
+        // sampled blocks not yet freed, and a counting filter over their addresses,
+        // so deallocate only takes the lock for blocks that may have been sampled
+        static std::atomic<std::size_t> s_live_samples;
+        static std::atomic<std::uint32_t> s_filter[filter_size];
+        static __thread std::int64_t s_countdown;
+        static __thread std::uint64_t s_random;
+        static __thread bool s_sampling;
+
+        static state &shared() {
+            static state *s = new state();    // never destroyed, arenas may outlive static destruction
+            return *s;
+        }
+
+        static inline std::size_t filter_slot(const void *p) noexcept {
+            return static_cast<std::size_t>((reinterpret_cast<std::uintptr_t>(p) >> 4) * 0x9E3779B97F4A7C15ull >> 52) & (filter_size - 1);
+        }
+
+        static inline std::size_t bucket(std::uint64_t value) noexcept {
+            std::size_t b = 0;
+            while (value > 1 && b < histogram_buckets - 1) {
+                value >>= 1;
+                b++;
+            }
+            return b;
+        }
+
+        // bytes until the next sample, exponentially distributed about the sample rate
+        static std::int64_t next_interval(std::size_t rate) noexcept {
+            if (s_random == 0) {
+                s_random = reinterpret_cast<std::uintptr_t>(&s_random) ^ static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^ 0x2545F4914F6CDD1Dull;
+            }
+            s_random ^= s_random << 13;
+            s_random ^= s_random >> 7;
+            s_random ^= s_random << 17;
+            // 53 random bits as a uniform double in (0, 1]
+            const double u = (static_cast<double>(s_random >> 11) + 1.0) / 9007199254740992.0;
+            const double interval = -std::log(u) * static_cast<double>(rate);
+            return static_cast<std::int64_t>(std::min(interval, static_cast<double>(std::numeric_limits<std::int32_t>::max()))) + 1;
+        }
+
+        static std::size_t find_site(state &st, const void *arena, void **frames, std::size_t depth) {
+            std::size_t hash = std::hash<const void *>()(arena);
+            for (std::size_t i = 0; i < depth; ++i) {
+                hash = hash * 31 + std::hash<void *>()(frames[i]);
+            }
+            std::vector<std::size_t> &candidates = st.m_sites_by_hash[hash];
+            for (std::size_t index : candidates) {
+                const site &s = st.m_sites[index];
+                if (s.m_arena == arena && s.m_frames.size() == depth && std::equal(frames, frames + depth, s.m_frames.begin())) {
+                    return index;
+                }
+            }
+            site s{arena, std::vector<void *>(frames, frames + depth), 0.0, 0.0, 0.0, 0.0, {}, {}};
+            st.m_sites.push_back(std::move(s));
+            candidates.push_back(st.m_sites.size() - 1);
+            return st.m_sites.size() - 1;
+        }
+
+        __attribute__((noinline)) static void record(const void *arena, const void *p, std::size_t size) {
+            const std::size_t rate = s_sample_rate.load(std::memory_order_relaxed);
+            if (rate == 0) {
+                s_countdown = disabled_interval;
+                return;
+            }
+            s_countdown = next_interval(rate);
+            if (s_sampling || p == nullptr) {
+                return;
+            }
+            s_sampling = true;
+
+            void *frames[max_frames + 1];
+            const int captured = ::backtrace(frames, static_cast<int>(max_frames + 1));
+            // drop this function's own frame
+            const std::size_t depth = captured > 1 ? static_cast<std::size_t>(captured - 1) : 0;
+
+            // the unbiased estimate of what this sample stands for: a block of 'size'
+            // bytes is sampled with probability 1 - exp(-size / rate)
+            const double blocks = 1.0 / (1.0 - std::exp(-static_cast<double>(size) / static_cast<double>(rate)));
+            const double bytes = blocks * static_cast<double>(size);
+
+            state &st = shared();
+            {
+                std::lock_guard<std::mutex> guard(st.m_lock);
+                const std::size_t index = find_site(st, arena, frames + 1, depth);
+                site &s = st.m_sites[index];
+                s.m_allocated_bytes += bytes;
+                s.m_allocated_blocks += blocks;
+                s.m_live_bytes += bytes;
+                s.m_live_blocks += blocks;
+                s.m_sizes[bucket(size)]++;
+                // a block resized in place and freed through a path without the hook
+                // leaves a stale sample behind, count it as freed when the address comes round again
+                auto stale = st.m_live.find(p);
+                if (stale != st.m_live.end()) {
+                    retire(st, stale);
+                }
+                st.m_live.emplace(p, sample{index, bytes, blocks, std::chrono::steady_clock::now()});
+                s_filter[filter_slot(p)].fetch_add(1, std::memory_order_relaxed);
+                s_live_samples.fetch_add(1, std::memory_order_release);
+            }
+            s_sampling = false;
+        }
+
+        // the sampled block at 'it' has been freed, the lock is held
+        static void retire(state &st, typename std::unordered_map<const void *, sample>::iterator it) noexcept {
+            const sample &smp = it->second;
+            site &s = st.m_sites[smp.m_site];
+            s.m_live_bytes -= smp.m_bytes;
+            s.m_live_blocks -= smp.m_blocks;
+            const auto lifetime = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - smp.m_allocated).count();
+            s.m_lifetimes[bucket(static_cast<std::uint64_t>(lifetime))]++;
+            s_filter[filter_slot(it->first)].fetch_sub(1, std::memory_order_relaxed);
+            s_live_samples.fetch_sub(1, std::memory_order_relaxed);
+            st.m_live.erase(it);
+        }
+
+        __attribute__((noinline)) static void release(const void *p) {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            auto it = st.m_live.find(p);
+            if (it != st.m_live.end()) {
+                retire(st, it);
+            }
+        }
+
+        static double weight(const site &s, metric m) noexcept {
+            switch (m) {
+                case allocated_bytes: return s.m_allocated_bytes;
+                case allocated_blocks: return s.m_allocated_blocks;
+                case live_bytes: return s.m_live_bytes;
+                case live_blocks: return s.m_live_blocks;
+            }
+            return 0.0;
+        }
+
+        static std::string frame_name(void *address) {
+            Dl_info info;
+            if (::dladdr(address, &info) != 0) {
+                if (info.dli_sname != nullptr) {
+                    int status = 0;
+                    char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+                    std::string name(status == 0 && demangled != nullptr ? demangled : info.dli_sname);
+                    std::free(demangled);
+                    return name;
+                }
+                if (info.dli_fname != nullptr) {
+                    std::string module(info.dli_fname);
+                    const std::size_t slash = module.rfind('/');
+                    char offset[32];
+                    std::snprintf(offset, sizeof(offset), "+0x%zx", static_cast<std::size_t>(static_cast<const char *>(address) - static_cast<const char *>(info.dli_fbase)));
+                    return (slash == std::string::npos ? module : module.substr(slash + 1)) + offset;
+                }
+            }
+            char raw[32];
+            std::snprintf(raw, sizeof(raw), "%p", address);
+            return raw;
+        }
+
+        static std::string arena_name(const state &st, const void *arena) {
+            auto it = st.m_arena_names.find(arena);
+            if (it != st.m_arena_names.end()) {
+                return it->second;
+            }
+            char raw[48];
+            std::snprintf(raw, sizeof(raw), "arena %p", arena);
+            return raw;
+        }
+
+        static void write_histogram(std::ostream &out, const char *label, const std::uint64_t (&buckets)[histogram_buckets], const char *unit) {
+            out << "    " << label << ":";
+            for (std::size_t b = 0; b < histogram_buckets; ++b) {
+                if (buckets[b] != 0) {
+                    out << " <=" << (std::uint64_t(1) << b) << unit << ":" << buckets[b];
+                }
+            }
+            out << "\n";
+        }
+
+    public:
+        // sample one allocation in about every 'sample_rate' bytes, on every thread
+        static void start(std::size_t sample_rate = 512 * 1024) noexcept {
+            s_sample_rate.store(std::max<std::size_t>(sample_rate, 1), std::memory_order_relaxed);
+            s_countdown = 0;
+        }
+
+        // stop taking samples, those already taken are kept, and their frees still recorded
+        static void stop() noexcept {
+            s_sample_rate.store(0, std::memory_order_relaxed);
+        }
+
+        static bool enabled() noexcept {
+            return s_sample_rate.load(std::memory_order_relaxed) != 0;
+        }
+
+        // forget every site, blocks sampled so far are no longer tracked
+        static void reset() {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            st.m_sites.clear();
+            st.m_sites_by_hash.clear();
+            st.m_live.clear();
+            for (std::atomic<std::uint32_t> &slot : s_filter) {
+                slot.store(0, std::memory_order_relaxed);
+            }
+            s_live_samples.store(0, std::memory_order_relaxed);
+        }
+
+        // the root frame of every stack allocated from 'arena'
+        static void name_arena(const void *arena, std::string name) {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            st.m_arena_names[arena] = std::move(name);
+        }
+
+        // called by the arenas for every block they hand out, and take back
+        static inline void allocated(const void *arena, const void *p, std::size_t size) noexcept {
+            if (unlikely((s_countdown -= static_cast<std::int64_t>(size)) < 0)) {
+                record(arena, p, size);
+            }
+        }
+
+        static inline void deallocated(const void *p) noexcept {
+            if (unlikely(s_live_samples.load(std::memory_order_acquire) != 0) && s_filter[filter_slot(p)].load(std::memory_order_relaxed) != 0) {
+                release(p);
+            }
+        }
+
+        static std::size_t site_count() {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            return st.m_sites.size();
+        }
+
+        // One line per site in the folded format read by flamegraph.pl and speedscope:
+        // the arena, then the frames from outermost to innermost, separated by ';', then
+        // the weight. Sites whose weight rounds to zero are left out.
+        static void write_folded(std::ostream &out, metric m = allocated_bytes) {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            std::unordered_map<void *, std::string> names;
+            for (const site &s : st.m_sites) {
+                const double w = weight(s, m);
+                if (w < 0.5) {
+                    continue;
+                }
+                out << arena_name(st, s.m_arena);
+                for (auto it = s.m_frames.rbegin(); it != s.m_frames.rend(); ++it) {
+                    auto name = names.find(*it);
+                    if (name == names.end()) {
+                        name = names.emplace(*it, frame_name(*it)).first;
+                    }
+                    out << ';' << name->second;
+                }
+                out << ' ' << static_cast<std::uint64_t>(w + 0.5) << '\n';
+            }
+        }
+
+        // the heaviest 'limit' sites with their innermost frames and histograms, for reading rather than tools
+        static void write_report(std::ostream &out, metric m = allocated_bytes, std::size_t limit = 10, std::size_t frames = 6) {
+            state &st = shared();
+            std::lock_guard<std::mutex> guard(st.m_lock);
+            std::vector<const site *> order;
+            for (const site &s : st.m_sites) {
+                order.push_back(&s);
+            }
+            std::sort(order.begin(), order.end(), [m](const site *a, const site *b) { return weight(*a, m) > weight(*b, m); });
+            for (std::size_t i = 0; i < std::min(limit, order.size()); ++i) {
+                const site &s = *order[i];
+                out << arena_name(st, s.m_arena) << ": ~" << static_cast<std::uint64_t>(s.m_allocated_bytes) << " bytes in ~" << static_cast<std::uint64_t>(s.m_allocated_blocks)
+                    << " blocks, ~" << static_cast<std::uint64_t>(std::max(s.m_live_bytes, 0.0)) << " bytes live\n";
+                for (std::size_t f = 0; f < std::min(frames, s.m_frames.size()); ++f) {
+                    out << "    #" << f << ' ' << frame_name(s.m_frames[f]) << "\n";
+                }
+                write_histogram(out, "sizes", s.m_sizes, "B");
+                write_histogram(out, "lifetimes", s.m_lifetimes, "us");
+            }
+        }
+    };
+
+    template <typename Tag> constexpr std::size_t basic_allocation_profiler<Tag>::max_frames;
+    template <typename Tag> constexpr std::size_t basic_allocation_profiler<Tag>::histogram_buckets;
+    template <typename Tag> constexpr std::int64_t basic_allocation_profiler<Tag>::disabled_interval;
+    template <typename Tag> std::atomic<std::size_t> basic_allocation_profiler<Tag>::s_sample_rate{0};
+    template <typename Tag> std::atomic<std::size_t> basic_allocation_profiler<Tag>::s_live_samples{0};
+    template <typename Tag> std::atomic<std::uint32_t> basic_allocation_profiler<Tag>::s_filter[basic_allocation_profiler<Tag>::filter_size];
+    template <typename Tag> __thread std::int64_t basic_allocation_profiler<Tag>::s_countdown = 0;
+    template <typename Tag> __thread std::uint64_t basic_allocation_profiler<Tag>::s_random = 0;
+    template <typename Tag> __thread bool basic_allocation_profiler<Tag>::s_sampling = false;
+
+    using allocation_profiler = basic_allocation_profiler<>;
+}
+
+#endif //FASTPATH_ALLOCATION_PROFILER_H
@@ -0,0 +1,228 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+// The AlloctorTests workloads as microbenchmarks, one per allocator x type x workload.
+// The framework picks the iteration counts and reports time per operation along with
+// items/s and bytes/s, and every block handed out is passed through DoNotOptimize so
+// allocate/deallocate pairs can't be folded away. Select with the usual flags, e.g.
+//   AllocatorBenchmarks --benchmark_filter='RandomSize/tf::tlsf_arena'
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "fast_linear_allocator.h"
+#include "arena_unoptimised.h"
+#include "new_arena.h"
+#include "short_alloc.h"
+#include "new_delete_allocator.h"
+#include "epoch_arena.h"
+#include "tlsf_arena.h"
+#include "buddy_arena.h"
+
+namespace {
+
+    struct small_obj {
+        char data[200];
+        int a;
+        bool b;
+        float c;
+    };
+
+    struct large_obj {
+        char data[3456];
+        int data2[1234];
+    };
+
+    // The random workloads replay a fixed pattern of this many steps, so each
+    // benchmark iteration is one step and the pattern is the same for every allocator
+    const std::size_t pattern_length = 1 << 16;
+
+    // the random workloads never hold more than this many blocks or bytes, whatever the iteration count
+    const std::size_t live_limit = 4096;
+    const std::size_t live_bytes_limit = 256 * 1024 * 1024;
+
+    struct pattern {
+        std::vector<bool> m_add;
+        std::vector<std::size_t> m_size;
+        std::vector<std::size_t> m_victim;
+
+        pattern() : m_add(pattern_length), m_size(pattern_length), m_victim(pattern_length) {
+            std::mt19937_64 rng(0x5eed);
+            std::uniform_int_distribution<std::size_t> size(0, 1024);
+            for (std::size_t i = 0; i < pattern_length; ++i) {
+                m_add[i] = (rng() & 1) != 0;
+                m_size[i] = size(rng);
+                m_victim[i] = static_cast<std::size_t>(rng());
+            }
+        }
+    };
+
+    const pattern &workload_pattern() {
+        static const pattern p;
+        return p;
+    }
+
+    template <typename A> void AllocateDeallocate(benchmark::State &state, A &allocator) {
+        for (auto _ : state) {
+            auto ptr = std::allocator_traits<A>::allocate(allocator, 100);
+            benchmark::DoNotOptimize(ptr);
+            std::allocator_traits<A>::deallocate(allocator, ptr, 100);
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(state.iterations() * 100 * sizeof(typename std::allocator_traits<A>::value_type));
+    }
+
+    // Blocks of 100 or of random sizes allocated and freed in a random order. Frees take
+    // a random live block and swap the last one into its place, so the bookkeeping is O(1).
+    template <typename A, bool RandomSize> void RandomAllocationDeallocate(benchmark::State &state, A &allocator) {
+        typedef typename std::allocator_traits<A>::pointer pointer;
+        const pattern &p = workload_pattern();
+
+        const std::size_t element = sizeof(typename std::allocator_traits<A>::value_type);
+
+        std::vector<std::pair<std::size_t, pointer>> live;
+        live.reserve(live_limit);
+        std::size_t live_bytes = 0;
+
+        std::size_t i = 0;
+        std::int64_t allocated = 0;
+        std::int64_t bytes = 0;
+        for (auto _ : state) {
+            const std::size_t step = i++ & (pattern_length - 1);
+            const std::size_t size = RandomSize ? p.m_size[step] : 100;
+            const bool add = live.empty() || (p.m_add[step] && live.size() < live_limit && live_bytes + size * element <= live_bytes_limit);
+            if (add) {
+                pointer ptr = std::allocator_traits<A>::allocate(allocator, size);
+                benchmark::DoNotOptimize(ptr);
+                live.emplace_back(size, ptr);
+                live_bytes += size * element;
+                ++allocated;
+                bytes += size;
+            } else {
+                const std::size_t index = p.m_victim[step] % live.size();
+                std::allocator_traits<A>::deallocate(allocator, live[index].second, live[index].first);
+                live_bytes -= live[index].first * element;
+                live[index] = live.back();
+                live.pop_back();
+            }
+            benchmark::ClobberMemory();
+        }
+
+        // timing has already stopped once the loop ends
+        for (const auto &block : live) {
+            std::allocator_traits<A>::deallocate(allocator, block.second, block.first);
+        }
+
+        state.SetItemsProcessed(state.iterations());
+        state.SetBytesProcessed(bytes * element);
+        state.counters["allocations"] = benchmark::Counter(static_cast<double>(allocated), benchmark::Counter::kIsRate);
+    }
+
+    // Each benchmark owns its arena, so one benchmark's growth and fragmentation
+    // doesn't carry over into the next
+    const std::size_t pre_alloc_size = 1024 * 1024;
+
+    template <typename T, typename Arena> struct arena_allocator {
+        Arena m_arena;
+        tf::linear_allocator<T, Arena> m_allocator;
+
+        template <typename... Args> explicit arena_allocator(Args &&... args) : m_arena(std::forward<Args>(args)...), m_allocator(m_arena) {}
+    };
+
+    template <typename T, typename Arena, typename... Args> void registerArena(const std::string &workload, const std::string &name, const std::string &type,
+                                                                                 void (*run)(benchmark::State &, tf::linear_allocator<T, Arena> &), Args... args) {
+        benchmark::RegisterBenchmark((workload + "/" + name + "/" + type).c_str(), [=](benchmark::State &state) {
+            arena_allocator<T, Arena> a(args...);
+            run(state, a.m_allocator);
+        });
+    }
+
+    template <typename A> void registerPlain(const std::string &workload, const std::string &name, const std::string &type, void (*run)(benchmark::State &, A &)) {
+        benchmark::RegisterBenchmark((workload + "/" + name + "/" + type).c_str(), [=](benchmark::State &state) {
+            A allocator;
+            run(state, allocator);
+        });
+    }
+
+    template <typename T, template <typename> class Workload> void registerAllocators(const std::string &workload, const std::string &type) {
+        registerPlain<std::allocator<T>>(workload, "std::allocator", type, &Workload<std::allocator<T>>::run);
+        registerPlain<new_delete_allocator<T>>(workload, "new_delete_allocator", type, &Workload<new_delete_allocator<T>>::run);
+        registerPlain<new_delete_allocator<T, new_delete_mode::raw>>(workload, "new_delete_allocator<raw>", type, &Workload<new_delete_allocator<T, new_delete_mode::raw>>::run);
+        registerPlain<new_delete_allocator<T, new_delete_mode::sized>>(workload, "new_delete_allocator<sized>", type, &Workload<new_delete_allocator<T, new_delete_mode::sized>>::run);
+
+        registerArena<T, tf::arena>(workload, "tf::arena", type, &Workload<tf::linear_allocator<T, tf::arena>>::run, pre_alloc_size);
+        registerArena<T, tf::arena_unoptimised>(workload, "tf::arena_unoptimised", type, &Workload<tf::linear_allocator<T, tf::arena_unoptimised>>::run, pre_alloc_size);
+        registerArena<T, tf::new_arena<pre_alloc_size>>(workload, "tf::new_arena", type, &Workload<tf::linear_allocator<T, tf::new_arena<pre_alloc_size>>>::run);
+        registerArena<T, tf::epoch_arena>(workload, "tf::epoch_arena", type, &Workload<tf::linear_allocator<T, tf::epoch_arena>>::run, pre_alloc_size);
+        registerArena<T, tf::tlsf_arena<>>(workload, "tf::tlsf_arena", type, &Workload<tf::linear_allocator<T, tf::tlsf_arena<>>>::run, pre_alloc_size);
+        registerArena<T, tf::buddy_arena<>>(workload, "tf::buddy_arena", type, &Workload<tf::linear_allocator<T, tf::buddy_arena<>>>::run, pre_alloc_size);
+
+        benchmark::RegisterBenchmark((workload + "/short_alloc/" + type).c_str(), [](benchmark::State &state) {
+            typename short_alloc<T, 4096>::arena_type arena;
+            short_alloc<T, 4096> allocator(arena);
+            Workload<short_alloc<T, 4096>>::run(state, allocator);
+        });
+    }
+
+    template <typename A> struct allocate_deallocate {
+        static void run(benchmark::State &state, A &allocator) { AllocateDeallocate(state, allocator); }
+    };
+
+    template <typename A> struct random_allocation_deallocate {
+        static void run(benchmark::State &state, A &allocator) { RandomAllocationDeallocate<A, false>(state, allocator); }
+    };
+
+    template <typename A> struct random_size {
+        static void run(benchmark::State &state, A &allocator) { RandomAllocationDeallocate<A, true>(state, allocator); }
+    };
+
+    template <typename T> void registerType(const std::string &type) {
+        registerAllocators<T, allocate_deallocate>("AllocateDeallocate", type);
+        registerAllocators<T, random_allocation_deallocate>("RandomAllocationDeallocate", type);
+        registerAllocators<T, random_size>("AllocateDeallocateRandomSize", type);
+    }
+}
+
+int main(int argc, char **argv) {
+    registerType<char>("char");
+    registerType<std::uint32_t>("uint32_t");
+    registerType<std::uint64_t>("uint64_t");
+    registerType<small_obj>("small_obj");
+    registerType<large_obj>("large_obj");
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,624 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+// A differential correctness harness: one sequence of allocations, frees, reallocations
+// and zeroed allocations, decoded from a string of bytes, replayed against every
+// allocator. Along the way it checks that live blocks never overlap, that every block
+// is 16 byte aligned, that what was written to a block is still there when it is freed
+// or moved, and that zeroed blocks start out zero; and, once everything has been freed,
+// that the allocator's own counters are back to zero. The allocators meant to be
+// shared between threads also get blocks allocated on one thread and freed on
+// another, and new_arena's slab exchange runs under several threads at once. A
+// failure aborts with a description of the subject and operation, so either driver
+// reports it:
+//   AllocatorFuzzer  libFuzzer, where the compiler has -fsanitize=fuzzer
+//   AllocatorFuzz    byte strings from a seeded generator, run by ctest, e.g.
+//                    AllocatorFuzz --runs 1000 --seed 42
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "fast_linear_allocator.h"
+#include "arena_unoptimised.h"
+#include "optimised_arena.h"
+#include "new_arena.h"
+#include "epoch_arena.h"
+#include "tlsf_arena.h"
+#include "buddy_arena.h"
+#include "deferred_free.h"
+#include "short_alloc.h"
+#include "slab_exchange.h"
+#include "new_delete_allocator.h"
+#include "persistent_arena.h"
+#include "arena_registry.h"
+
+namespace {
+
+    const std::size_t block_alignment = 16;
+    const std::size_t max_live_blocks = 1024;
+
+    // small slabs, so that chains grow long and frees cross slabs
+    const std::size_t slab_size = 4096;
+
+    enum class op_kind { allocate, allocate_zeroed, deallocate, reallocate, tick, free_all };
+
+    struct op {
+        op_kind m_kind;
+        std::size_t m_size;
+        std::size_t m_index;
+    };
+
+    // Four bytes an operation: the kind, two for the size and one picking the live block
+    // to free or resize. The top two bits of the size pick its scale, so most blocks are
+    // small but some run to 16 KiB, and zero byte blocks come up often.
+    std::vector<op> decode(const std::uint8_t *data, std::size_t size) {
+        std::vector<op> ops;
+        ops.reserve(size / 4);
+        for (std::size_t i = 0; i + 4 <= size; i += 4) {
+            const std::size_t kind = data[i] % 32;
+            const std::size_t raw = data[i + 1] | (static_cast<std::size_t>(data[i + 2]) << 8);
+
+            op o;
+            o.m_kind = kind < 10 ? op_kind::allocate
+                     : kind < 13 ? op_kind::allocate_zeroed
+                     : kind < 22 ? op_kind::deallocate
+                     : kind < 28 ? op_kind::reallocate
+                     : kind < 31 ? op_kind::tick
+                     : op_kind::free_all;
+            o.m_size = (raw & 0x3fff) >> ((raw >> 14) * 4);
+            o.m_index = data[i + 3];
+            ops.push_back(o);
+        }
+        return ops;
+    }
+
+    // std::allocator, short_alloc, new_delete_allocator and registry_allocator behind the arena interface
+    template <typename Allocator> struct allocator_arena {
+        using pointer = unsigned char *;
+
+        Allocator m_allocator;
+
+        template <typename... Args> explicit allocator_arena(Args &&... args) : m_allocator(std::forward<Args>(args)...) {}
+
+        pointer allocate(std::size_t size) { return m_allocator.allocate(size); }
+        void deallocate(pointer p, std::size_t size) noexcept { m_allocator.deallocate(p, size); }
+    };
+
+    // The operations some arenas lack, filled in from the ones they have; each overload
+    // taking an int is preferred to the one taking a long wherever it compiles
+
+    template <typename A> auto allocateZeroed(A &arena, std::size_t size, int) -> decltype(arena.allocate_zeroed(size)) {
+        return arena.allocate_zeroed(size);
+    }
+
+    template <typename A> typename A::pointer allocateZeroed(A &arena, std::size_t size, long) {
+        typename A::pointer p = arena.allocate(size);
+        std::memset(p, 0, size);
+        return p;
+    }
+
+    template <typename A> auto reallocate(A &arena, typename A::pointer p, std::size_t old_size, std::size_t new_size, int) -> decltype(arena.reallocate(p, old_size, new_size)) {
+        return arena.reallocate(p, old_size, new_size);
+    }
+
+    template <typename A> typename A::pointer reallocate(A &arena, typename A::pointer p, std::size_t old_size, std::size_t new_size, long) {
+        typename A::pointer n = arena.allocate(new_size);
+        std::memcpy(n, p, std::min(old_size, new_size));
+        arena.deallocate(p, old_size);
+        return n;
+    }
+
+    template <typename A> auto tick(A &arena, int) -> decltype(arena.advance_epoch(), void()) {
+        arena.advance_epoch();
+    }
+
+    template <typename A> auto tick(A &arena, int) -> decltype(arena.flush(), void()) {
+        arena.flush();
+    }
+
+    template <typename A> void tick(A &, long) {}
+
+    // the arena's own count of bytes in use, or zero where it keeps none
+    template <typename A> auto usedBytes(const A &arena, int) -> decltype(arena.used_bytes()) {
+        return arena.used_bytes();
+    }
+
+    template <typename A, std::size_t C> std::size_t usedBytes(const tf::deferred_free<A, C> &arena, int) {
+        return usedBytes(arena.arena(), 0);
+    }
+
+    template <typename A> std::size_t usedBytes(const A &, long) {
+        return 0;
+    }
+
+    // where the arena counts with tf::counting_stats, its counts must match the live blocks exactly
+    template <typename A> auto checkStats(const A &arena, std::size_t live_bytes, std::size_t live_blocks, int) -> decltype(arena.stats().m_live_bytes, static_cast<const char *>(nullptr)) {
+        const auto stats = arena.stats();
+        if (stats.m_live_bytes != live_bytes) {
+            return "counting_stats live bytes differ from the bytes live";
+        }
+        if (stats.m_allocations - stats.m_deallocations != live_blocks) {
+            return "counting_stats allocations less deallocations differ from the blocks live";
+        }
+        return nullptr;
+    }
+
+    template <typename A> const char *checkStats(const A &, std::size_t, std::size_t, long) {
+        return nullptr;
+    }
+
+    // what each block should hold, a function of its seed so a block copied from the
+    // wrong place or shifted by a few bytes doesn't pass
+    inline void fill(unsigned char *p, std::size_t size, unsigned char seed) noexcept {
+        for (std::size_t i = 0; i < size; ++i) {
+            p[i] = static_cast<unsigned char>(seed + i);
+        }
+    }
+
+    inline bool intact(const unsigned char *p, std::size_t size, unsigned char seed) noexcept {
+        for (std::size_t i = 0; i < size; ++i) {
+            if (p[i] != static_cast<unsigned char>(seed + i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename A> class subject_run {
+        using pointer = typename A::pointer;
+
+        struct block {
+            pointer m_ptr;
+            std::size_t m_size;
+            unsigned char m_seed;
+        };
+
+        const char *m_name;
+        A &m_arena;
+        std::vector<block> m_live;
+        // the live blocks of one byte or more, start to end, for the overlap check
+        std::map<std::uintptr_t, std::uintptr_t> m_ranges;
+        std::size_t m_live_bytes;
+        std::size_t m_op;
+        unsigned char m_next_seed;
+
+        void fail(const char *what) const {
+            std::cerr << m_name << ": operation " << m_op << ": " << what << std::endl;
+            std::abort();
+        }
+
+        void add(pointer p, std::size_t size, bool zeroed) {
+            if (p == nullptr) {
+                fail("allocation returned null");
+            }
+            if (reinterpret_cast<std::uintptr_t>(p) % block_alignment != 0) {
+                fail("block is not 16 byte aligned");
+            }
+            if (zeroed) {
+                for (std::size_t i = 0; i < size; ++i) {
+                    if (p[i] != 0) {
+                        fail("zeroed block is not zero");
+                    }
+                }
+            }
+            if (size != 0) {
+                const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(p);
+                const std::uintptr_t end = start + size;
+                auto next = m_ranges.lower_bound(start);
+                if (next != m_ranges.end() && next->first < end) {
+                    fail("block overlaps a live block above it");
+                }
+                if (next != m_ranges.begin() && std::prev(next)->second > start) {
+                    fail("block overlaps a live block below it");
+                }
+                m_ranges.emplace_hint(next, start, end);
+            }
+
+            const unsigned char seed = m_next_seed++;
+            fill(p, size, seed);
+            m_live.push_back({p, size, seed});
+            m_live_bytes += size;
+        }
+
+        // takes the block out of the live set, checking it first
+        block remove(std::size_t index) {
+            const block b = m_live[index];
+            if (!intact(b.m_ptr, b.m_size, b.m_seed)) {
+                fail("block contents changed while it was live");
+            }
+            if (b.m_size != 0) {
+                m_ranges.erase(reinterpret_cast<std::uintptr_t>(b.m_ptr));
+            }
+            m_live[index] = m_live.back();
+            m_live.pop_back();
+            m_live_bytes -= b.m_size;
+            return b;
+        }
+
+        void check_counters() const {
+            if (usedBytes(m_arena, 0) != 0 && usedBytes(m_arena, 0) < m_live_bytes) {
+                fail("arena reports fewer bytes in use than are live");
+            }
+            if (const char *error = checkStats(m_arena, m_live_bytes, m_live.size(), 0)) {
+                fail(error);
+            }
+        }
+
+    public:
+        subject_run(const char *name, A &arena) : m_name(name), m_arena(arena), m_live_bytes(0), m_op(0), m_next_seed(0) {
+            m_live.reserve(max_live_blocks);
+        }
+
+        void run(const std::vector<op> &ops) {
+            for (const op &o : ops) {
+                const op_kind kind = (o.m_kind == op_kind::allocate || o.m_kind == op_kind::allocate_zeroed) && m_live.size() == max_live_blocks ? op_kind::deallocate : o.m_kind;
+                switch (kind) {
+                    case op_kind::allocate:
+                        add(m_arena.allocate(o.m_size), o.m_size, false);
+                        break;
+                    case op_kind::allocate_zeroed:
+                        add(allocateZeroed(m_arena, o.m_size, 0), o.m_size, true);
+                        break;
+                    case op_kind::deallocate:
+                        if (!m_live.empty()) {
+                            const block b = remove(o.m_index % m_live.size());
+                            m_arena.deallocate(b.m_ptr, b.m_size);
+                        }
+                        break;
+                    case op_kind::reallocate:
+                        if (!m_live.empty()) {
+                            const block b = remove(o.m_index % m_live.size());
+                            pointer p = reallocate(m_arena, b.m_ptr, b.m_size, o.m_size, 0);
+                            if (p != nullptr && !intact(p, std::min(b.m_size, o.m_size), b.m_seed)) {
+                                fail("reallocate lost the block's contents");
+                            }
+                            add(p, o.m_size, false);
+                        }
+                        break;
+                    case op_kind::tick:
+                        tick(m_arena, 0);
+                        break;
+                    case op_kind::free_all:
+                        while (!m_live.empty()) {
+                            const block b = remove(0);
+                            m_arena.deallocate(b.m_ptr, b.m_size);
+                        }
+                        break;
+                }
+                check_counters();
+                m_op++;
+            }
+
+            while (!m_live.empty()) {
+                const block b = remove(m_live.size() - 1);
+                m_arena.deallocate(b.m_ptr, b.m_size);
+            }
+            tick(m_arena, 0);
+            if (usedBytes(m_arena, 0) != 0) {
+                fail("arena still reports bytes in use after everything was freed");
+            }
+            check_counters();
+        }
+    };
+
+    template <typename A> void runSubject(const char *name, A &arena, const std::vector<op> &ops) {
+        subject_run<A>(name, arena).run(ops);
+    }
+
+    void handoffFailure(const char *name, const char *what) {
+        std::cerr << name << ": handed off between threads: " << what << std::endl;
+        std::abort();
+    }
+
+    // For the allocators meant to be shared between threads: the operations' allocations
+    // are made and filled on this thread and handed to another, which checks each block
+    // is intact and frees it, while this thread's frees and resizes allocate and free a
+    // block of its own, so both threads are in the allocator at once.
+    template <typename A> void runHandoff(const char *name, A &arena, const std::vector<op> &ops) {
+        using pointer = typename A::pointer;
+
+        struct handoff {
+            pointer m_ptr;
+            std::size_t m_size;
+            unsigned char m_seed;
+        };
+
+        std::mutex lock;
+        std::condition_variable ready;
+        std::deque<handoff> queue;
+        bool done = false;
+
+        std::thread consumer([&] {
+            std::unique_lock<std::mutex> guard(lock);
+            for (;;) {
+                ready.wait(guard, [&] { return !queue.empty() || done; });
+                if (queue.empty()) {
+                    return;
+                }
+                const handoff h = queue.front();
+                queue.pop_front();
+                guard.unlock();
+                if (!intact(h.m_ptr, h.m_size, h.m_seed)) {
+                    handoffFailure(name, "block contents changed before it was freed");
+                }
+                arena.deallocate(h.m_ptr, h.m_size);
+                guard.lock();
+            }
+        });
+
+        unsigned char seed = 0;
+        for (const op &o : ops) {
+            if (o.m_kind == op_kind::tick || o.m_kind == op_kind::free_all) {
+                continue;
+            }
+            pointer p = arena.allocate(o.m_size);
+            if (p == nullptr || reinterpret_cast<std::uintptr_t>(p) % block_alignment != 0) {
+                handoffFailure(name, "allocation returned null or a misaligned block");
+            }
+            fill(p, o.m_size, seed);
+            if (o.m_kind == op_kind::deallocate || o.m_kind == op_kind::reallocate) {
+                if (!intact(p, o.m_size, seed)) {
+                    handoffFailure(name, "block contents changed while it was live");
+                }
+                arena.deallocate(p, o.m_size);
+            } else {
+                std::lock_guard<std::mutex> guard(lock);
+                queue.push_back({p, o.m_size, seed});
+                ready.notify_one();
+            }
+            seed++;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            done = true;
+            ready.notify_one();
+        }
+        consumer.join();
+
+        if (usedBytes(arena, 0) != 0) {
+            handoffFailure(name, "arena still reports bytes in use after everything was freed");
+        }
+        if (const char *error = checkStats(arena, 0, 0, 0)) {
+            handoffFailure(name, error);
+        }
+    }
+
+    // new_arena's slab chains belong to the thread using them, so its blocks are always
+    // freed where they were allocated; what crosses threads is the slabs, published to
+    // the exchange as they empty and taken by whichever thread runs dry. Each wave of
+    // threads runs the operations, from different starting points, all at once, so the
+    // exchange's slots are claimed and filled concurrently, and the second wave starts
+    // out on the slabs the first left behind.
+    void runExchangeThreads(const std::vector<op> &ops) {
+        using exchange_arena = tf::new_arena<slab_size, tf::slab_exchange<>>;
+        const std::size_t thread_count = 4;
+        for (std::size_t wave = 0; wave < 2; ++wave) {
+            std::vector<std::thread> threads;
+            for (std::size_t t = 0; t < thread_count; ++t) {
+                threads.emplace_back([&ops, t] {
+                    std::vector<op> mine(ops.begin() + static_cast<std::ptrdiff_t>(t * ops.size() / thread_count), ops.end());
+                    mine.insert(mine.end(), ops.begin(), ops.begin() + static_cast<std::ptrdiff_t>(t * ops.size() / thread_count));
+                    exchange_arena arena;
+                    runSubject("tf::new_arena<slab_exchange>, threaded", arena, mine);
+                });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+        }
+        exchange_arena::trim();
+    }
+
+    // every kind of arena, each taking a range of sizes, and the largest left to the system
+    const char *const registry_config =
+        "arena small arena 4096\n"
+        "arena medium tlsf 65536\n"
+        "arena large buddy 1048576\n"
+        "size 0 64 small\n"
+        "size 64 1024 medium\n"
+        "size 1024 4096 large\n";
+
+    template <typename Mode> using new_delete_arena = allocator_arena<new_delete_allocator<unsigned char, Mode>>;
+
+    using counted_arena = tf::basic_arena<tf::mapped_slabs, tf::fixed_growth, tf::current_slab_lookup, tf::null_lock, tf::counting_stats>;
+    using chained_arena = tf::basic_arena<tf::malloc_slabs, tf::geometric_growth<>, tf::chain_lookup, tf::spin_lock, tf::counting_stats>;
+
+    void runAll(const std::vector<op> &ops) {
+        {
+            allocator_arena<std::allocator<unsigned char>> arena;
+            runSubject("std::allocator", arena, ops);
+        }
+        {
+            tf::arena arena(slab_size);
+            runSubject("tf::arena", arena, ops);
+        }
+        {
+            tf::arena_unoptimised arena(slab_size);
+            runSubject("tf::arena_unoptimised", arena, ops);
+        }
+        {
+            tf::optimised_arena arena(slab_size);
+            runSubject("tf::optimised_arena", arena, ops);
+        }
+        {
+            counted_arena arena(slab_size);
+            runSubject("basic_arena<counting_stats>", arena, ops);
+        }
+        {
+            chained_arena arena(slab_size);
+            runSubject("basic_arena<malloc, geometric, chain, spin_lock>", arena, ops);
+        }
+        {
+            tf::arena arena(slab_size);
+            tf::deferred_free<tf::arena, 8> deferred(arena);
+            runSubject("tf::deferred_free<tf::arena, 8>", deferred, ops);
+        }
+        {
+            tf::new_arena<slab_size> arena;
+            runSubject("tf::new_arena", arena, ops);
+        }
+        {
+            using exchange_arena = tf::new_arena<slab_size, tf::slab_exchange<>>;
+            {
+                exchange_arena arena;
+                runSubject("tf::new_arena<slab_exchange>", arena, ops);
+            }
+            // the spares the arena parked for other threads
+            exchange_arena::trim();
+        }
+        {
+            tf::epoch_arena arena(slab_size);
+            runSubject("tf::epoch_arena", arena, ops);
+        }
+        {
+            tf::tlsf_arena<> arena(slab_size);
+            runSubject("tf::tlsf_arena", arena, ops);
+        }
+        {
+            tf::buddy_arena<> arena(slab_size);
+            runSubject("tf::buddy_arena", arena, ops);
+        }
+        {
+            short_alloc<unsigned char, 4096>::arena_type buffer;
+            allocator_arena<short_alloc<unsigned char, 4096>> arena(buffer);
+            runSubject("short_alloc", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::array> arena;
+            runSubject("new_delete_allocator<array>", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::raw> arena;
+            runSubject("new_delete_allocator<raw>", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::sized> arena;
+            runSubject("new_delete_allocator<sized>", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::aligned> arena;
+            runSubject("new_delete_allocator<aligned>", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::usable_size> arena;
+            runSubject("new_delete_allocator<usable_size>", arena, ops);
+        }
+        {
+            // a file of its own, unlinked as soon as it is mapped
+            char path[] = "/tmp/allocator_fuzz.XXXXXX";
+            const int fd = ::mkstemp(path);
+            if (fd < 0) {
+                std::cerr << "tf::persistent_arena: cannot create a temporary file" << std::endl;
+                std::abort();
+            }
+            ::close(fd);
+            std::unique_ptr<tf::persistent_arena> arena;
+            try {
+                arena.reset(new tf::persistent_arena(path, 256 * 1024 * 1024, 64 * 1024));
+            } catch (...) {
+                ::unlink(path);
+                throw;
+            }
+            ::unlink(path);
+            runSubject("tf::persistent_arena", *arena, ops);
+        }
+        {
+            tf::arena_registry<> registry(registry_config);
+            allocator_arena<tf::registry_allocator<unsigned char>> arena(registry, "fuzz");
+            runSubject("tf::registry_allocator", arena, ops);
+        }
+
+        {
+            chained_arena arena(slab_size);
+            runHandoff("basic_arena<malloc, geometric, chain, spin_lock>", arena, ops);
+        }
+        {
+            new_delete_arena<new_delete_mode::sized> arena;
+            runHandoff("new_delete_allocator<sized>", arena, ops);
+        }
+        {
+            using registry_type = tf::arena_registry<tf::spin_lock>;
+            registry_type registry(registry_config);
+            allocator_arena<tf::registry_allocator<unsigned char, registry_type>> arena(registry, "fuzz");
+            runHandoff("tf::registry_allocator<spin_lock>", arena, ops);
+        }
+        runExchangeThreads(ops);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t *data, std::size_t size) {
+    runAll(decode(data, size));
+    return 0;
+}
+
+#if !defined(ALLOCATOR_FUZZER)
+
+int main(int argc, char **argv) {
+    std::size_t runs = 100;
+    std::size_t length = 4000;
+    std::uint64_t seed = 0x5eed;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string flag = argv[i];
+        const std::uint64_t value = std::strtoull(argv[i + 1], nullptr, 10);
+        if (flag == "--runs") {
+            runs = value;
+        } else if (flag == "--length") {
+            length = value;
+        } else if (flag == "--seed") {
+            seed = value;
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--runs N] [--length BYTES] [--seed S]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937_64 rng(seed);
+    std::vector<std::uint8_t> data(length);
+    for (std::size_t run = 0; run < runs; ++run) {
+        for (std::uint8_t &byte : data) {
+            byte = static_cast<std::uint8_t>(rng());
+        }
+        LLVMFuzzerTestOneInput(data.data(), data.size());
+    }
+
+    std::cout << runs << " runs of " << length / 4 << " operations passed" << std::endl;
+    return 0;
+}
+
+#endif
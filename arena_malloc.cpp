@@ -0,0 +1,603 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+// Drop-in malloc/free/operator new replacement built on the tf::arena slab scheme.
+//
+//   LD_PRELOAD=libarena_malloc.so ./AlloctorTests
+//
+// Each thread bump-allocates from its own chain of mmap'd slabs; a slab is
+// recycled once every block carved from it has been released. Every block is
+// preceded by a block_header recording its reservation, since free() is not
+// given a size. Slabs are aligned to their size so the owning slab (and so the
+// owning heap) can be found by masking the block address, which lets any thread
+// free a block by taking the owning heap's lock. Every heap's lock is held
+// across fork(), so the child never inherits one taken mid-update.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "optimize.h"
+
+namespace tf {
+    namespace arena_malloc {
+
+        using pointer = unsigned char *;
+
+        static const std::size_t alignment = 16;
+        static const std::size_t slab_size = 1024 * 1024;
+        static const std::size_t large_threshold = slab_size / 4;
+        static const std::size_t max_cached_slabs = 4;
+
+        static inline std::size_t align_up(std::size_t n, std::size_t a = alignment) noexcept {
+            return (n + (a - 1)) & ~(a - 1);
+        }
+
+        class spinlock {
+            std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+        public:
+            inline void lock() noexcept {
+                while (m_flag.test_and_set(std::memory_order_acquire)) {
+#if defined(__x86_64__) || defined(__i386__)
+                    __builtin_ia32_pause();
+#endif
+                }
+            }
+
+            inline void unlock() noexcept {
+                m_flag.clear(std::memory_order_release);
+            }
+        };
+
+        template <typename L> class scoped_lock {
+            L &m_lock;
+        public:
+            explicit scoped_lock(L &lock) noexcept : m_lock(lock) { m_lock.lock(); }
+            ~scoped_lock() noexcept { m_lock.unlock(); }
+            scoped_lock(const scoped_lock &) = delete;
+            scoped_lock &operator=(const scoped_lock &) = delete;
+        };
+
+        // sits immediately in front of every pointer we hand out
+        struct block_header {
+            static const std::size_t large_flag = 1;
+
+            std::size_t m_size;     // bytes reserved from the block base, large_flag set for direct mappings
+            std::size_t m_offset;   // distance from the block base to the user pointer
+
+            inline bool is_large() const noexcept { return (m_size & large_flag) != 0; }
+            inline std::size_t size() const noexcept { return m_size & ~large_flag; }
+            inline pointer base() noexcept { return reinterpret_cast<pointer>(this + 1) - m_offset; }
+            inline std::size_t usable() const noexcept { return size() - m_offset; }
+
+            static inline block_header *from(void *p) noexcept {
+                return static_cast<block_header *>(p) - 1;
+            }
+        };
+
+        static_assert(sizeof(block_header) == alignment, "block_header must preserve alignment");
+
+        struct heap;
+
+        // lives at the start of its own slab_size-aligned mapping
+        struct alignas(64) slab {
+            heap *m_owner;
+            pointer m_head;
+            pointer m_end;
+            std::size_t m_allocated;
+            slab *m_next;
+            slab *m_prev;
+
+            inline pointer content() noexcept { return reinterpret_cast<pointer>(this) + sizeof(slab); }
+
+            inline std::size_t free() const noexcept {
+                return static_cast<std::size_t>(m_end - m_head);
+            }
+
+            inline pointer allocate(std::size_t size) noexcept {
+                pointer p = m_head;
+                m_head += size;
+                m_allocated += size;
+                return p;
+            }
+
+            inline void deallocate(pointer ptr, std::size_t size) noexcept {
+                if ((m_allocated -= size) == 0) {
+                    m_head = content();
+                } else if (ptr + size == m_head) {
+                    m_head = ptr;
+                }
+            }
+
+            static inline slab *containing(void *p) noexcept {
+                return reinterpret_cast<slab *>(reinterpret_cast<std::uintptr_t>(p) & ~(slab_size - 1));
+            }
+        };
+
+        static void *map(std::size_t size) noexcept {
+            void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            return p == MAP_FAILED ? nullptr : p;
+        }
+
+        static void *map_aligned(std::size_t size, std::size_t align) noexcept {
+            pointer p = static_cast<pointer>(map(size + align));
+            if (p == nullptr) {
+                return nullptr;
+            }
+            pointer aligned = reinterpret_cast<pointer>(align_up(reinterpret_cast<std::uintptr_t>(p), align));
+            if (aligned != p) {
+                ::munmap(p, static_cast<std::size_t>(aligned - p));
+            }
+            std::size_t tail = static_cast<std::size_t>((p + size + align) - (aligned + size));
+            if (tail != 0) {
+                ::munmap(aligned + size, tail);
+            }
+            return aligned;
+        }
+
+        struct heap {
+            spinlock m_lock;
+            slab *m_root_slab = nullptr;
+            slab *m_current_slab = nullptr;
+            std::size_t m_empty_slabs = 0;
+            heap *m_next_orphan = nullptr;
+            // every heap ever made, for the fork handlers
+            heap *m_next_heap = nullptr;
+
+            slab *new_slab() noexcept {
+                slab *s = static_cast<slab *>(map_aligned(slab_size, slab_size));
+                if (s == nullptr) {
+                    return nullptr;
+                }
+                s->m_owner = this;
+                s->m_head = s->content();
+                s->m_end = reinterpret_cast<pointer>(s) + slab_size;
+                s->m_allocated = 0;
+                s->m_prev = m_current_slab;
+                s->m_next = nullptr;
+                if (m_current_slab != nullptr) {
+                    s->m_next = m_current_slab->m_next;
+                    if (s->m_next != nullptr) {
+                        s->m_next->m_prev = s;
+                    }
+                    m_current_slab->m_next = s;
+                } else {
+                    m_root_slab = s;
+                }
+                return s;
+            }
+
+            void release_slab(slab *s) noexcept {
+                if (s->m_prev != nullptr) {
+                    s->m_prev->m_next = s->m_next;
+                } else {
+                    m_root_slab = s->m_next;
+                }
+                if (s->m_next != nullptr) {
+                    s->m_next->m_prev = s->m_prev;
+                }
+                ::munmap(s, slab_size);
+            }
+
+            inline slab *find_slab_with_space(std::size_t size) noexcept {
+                for (slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                    if (s->free() >= size) {
+                        return s;
+                    }
+                }
+                return nullptr;
+            }
+
+            // 'size' is the full aligned reservation including the header
+            pointer allocate(std::size_t size) noexcept {
+                scoped_lock<spinlock> guard(m_lock);
+                if (likely(m_current_slab != nullptr && m_current_slab->free() >= size)) {
+                    return m_current_slab->allocate(size);
+                }
+
+                slab *s = find_slab_with_space(size);
+                if (s == nullptr && (s = new_slab()) == nullptr) {
+                    return nullptr;
+                }
+                if (s->m_allocated == 0 && m_empty_slabs != 0) {
+                    m_empty_slabs--;
+                }
+                m_current_slab = s;
+                return s->allocate(size);
+            }
+
+            void deallocate(slab *s, pointer ptr, std::size_t size) noexcept {
+                scoped_lock<spinlock> guard(m_lock);
+                s->deallocate(ptr, size);
+                if (s->m_allocated == 0 && s != m_current_slab) {
+                    // keep a few empty slabs around to absorb bursts, hand the rest back
+                    if (m_empty_slabs < max_cached_slabs) {
+                        m_empty_slabs++;
+                    } else {
+                        release_slab(s);
+                    }
+                }
+            }
+
+            bool try_expand(slab *s, pointer ptr, std::size_t old_size, std::size_t new_size) noexcept {
+                scoped_lock<spinlock> guard(m_lock);
+                if (ptr + old_size != s->m_head) {
+                    return false;
+                }
+                if (new_size > old_size && static_cast<std::size_t>(s->m_end - ptr) < new_size) {
+                    return false;
+                }
+                s->m_head = ptr + new_size;
+                s->m_allocated = s->m_allocated - old_size + new_size;
+                return true;
+            }
+        };
+
+        static spinlock s_heaps_lock;
+        static heap *s_heaps = nullptr;
+        static heap *s_orphaned_heaps = nullptr;
+        static pthread_key_t s_heap_key;
+        static std::atomic<bool> s_heap_key_created(false);
+        static __thread heap *t_heap __attribute__((tls_model("initial-exec"))) = nullptr;
+
+        // heaps are never unmapped, since other threads may still own blocks in them;
+        // an exiting thread's heap is parked and adopted by the next new thread
+        static void orphan_heap(void *h) noexcept {
+            scoped_lock<spinlock> guard(s_heaps_lock);
+            static_cast<heap *>(h)->m_next_orphan = s_orphaned_heaps;
+            s_orphaned_heaps = static_cast<heap *>(h);
+        }
+
+        static heap *thread_heap() noexcept {
+            if (likely(t_heap != nullptr)) {
+                return t_heap;
+            }
+
+            heap *h = nullptr;
+            {
+                scoped_lock<spinlock> guard(s_heaps_lock);
+                if (!s_heap_key_created.load(std::memory_order_relaxed)) {
+                    ::pthread_key_create(&s_heap_key, orphan_heap);
+                    s_heap_key_created.store(true, std::memory_order_relaxed);
+                }
+                if (s_orphaned_heaps != nullptr) {
+                    h = s_orphaned_heaps;
+                    s_orphaned_heaps = h->m_next_orphan;
+                    h->m_next_orphan = nullptr;
+                }
+            }
+
+            if (h == nullptr) {
+                void *m = map(align_up(sizeof(heap), 4096));
+                if (m == nullptr) {
+                    return nullptr;
+                }
+                h = new(m) heap();
+                scoped_lock<spinlock> guard(s_heaps_lock);
+                h->m_next_heap = s_heaps;
+                s_heaps = h;
+            }
+
+            t_heap = h;
+            ::pthread_setspecific(s_heap_key, h);
+            return h;
+        }
+
+        // a thread forking while another holds a heap's lock would leave that lock
+        // taken for good in the child, so fork() waits until every heap is quiet
+        static void lock_heaps() noexcept {
+            s_heaps_lock.lock();
+            for (heap *h = s_heaps; h != nullptr; h = h->m_next_heap) {
+                h->m_lock.lock();
+            }
+        }
+
+        static void unlock_heaps() noexcept {
+            for (heap *h = s_heaps; h != nullptr; h = h->m_next_heap) {
+                h->m_lock.unlock();
+            }
+            s_heaps_lock.unlock();
+        }
+
+        // registered when the library is loaded, rather than from inside malloc, as
+        // pthread_atfork may itself allocate
+        __attribute__((constructor)) static void register_fork_handlers() noexcept {
+            ::pthread_atfork(lock_heaps, unlock_heaps, unlock_heaps);
+        }
+
+        static void *allocate_large(std::size_t size, std::size_t align) noexcept {
+            const std::size_t page = 4096;
+            const std::size_t offset = align_up(sizeof(block_header), align);
+            const std::size_t length = align_up(offset + size, page);
+            pointer base = static_cast<pointer>(align > page ? map_aligned(length, align) : map(length));
+            if (base == nullptr) {
+                return nullptr;
+            }
+            block_header *h = block_header::from(base + offset);
+            h->m_size = length | block_header::large_flag;
+            h->m_offset = offset;
+            return base + offset;
+        }
+
+        static void *allocate(std::size_t size, std::size_t align = alignment) noexcept {
+            const std::size_t offset = align_up(sizeof(block_header), align);
+            const std::size_t total = align_up(offset + size);
+            if (unlikely(total < size || total > large_threshold)) {
+                return total < size ? nullptr : allocate_large(size, align);
+            }
+
+            heap *h = thread_heap();
+            if (unlikely(h == nullptr)) {
+                return nullptr;
+            }
+
+            // 'offset' already leaves room to move the user pointer up to the requested alignment
+            pointer base = h->allocate(total);
+            if (unlikely(base == nullptr)) {
+                return nullptr;
+            }
+            pointer p = reinterpret_cast<pointer>(align_up(reinterpret_cast<std::uintptr_t>(base) + sizeof(block_header), align));
+            block_header *header = block_header::from(p);
+            header->m_size = total;
+            header->m_offset = static_cast<std::size_t>(p - base);
+            return p;
+        }
+
+        static void deallocate(void *p) noexcept {
+            if (p == nullptr) {
+                return;
+            }
+            block_header *header = block_header::from(p);
+            pointer base = header->base();
+            if (header->is_large()) {
+                ::munmap(base, header->size());
+            } else {
+                slab *s = slab::containing(base);
+                s->m_owner->deallocate(s, base, header->size());
+            }
+        }
+
+        static void *reallocate(void *p, std::size_t size) noexcept {
+            if (p == nullptr) {
+                return allocate(size);
+            }
+            block_header *header = block_header::from(p);
+            if (size <= header->usable()) {
+                return p;
+            }
+
+            if (!header->is_large()) {
+                const std::size_t total = align_up(header->m_offset + size);
+                pointer base = header->base();
+                slab *s = slab::containing(base);
+                if (total >= size && total <= large_threshold && s->m_owner->try_expand(s, base, header->size(), total)) {
+                    header->m_size = total;
+                    return p;
+                }
+            }
+
+            void *n = allocate(size);
+            if (n != nullptr) {
+                std::memcpy(n, p, header->usable());
+                deallocate(p);
+            }
+            return n;
+        }
+
+        static inline bool power_of_two(std::size_t n) noexcept {
+            return n != 0 && (n & (n - 1)) == 0;
+        }
+
+        static inline bool valid_alignment(std::size_t align) noexcept {
+            return power_of_two(align) && align % sizeof(void *) == 0;
+        }
+
+        // for the C entry points, which report running out of memory through errno
+        static void *allocate_or_enomem(std::size_t size, std::size_t align = alignment) noexcept {
+            void *p = allocate(size, align);
+            if (unlikely(p == nullptr)) {
+                errno = ENOMEM;
+            }
+            return p;
+        }
+
+        static void *allocate_or_throw(std::size_t size, std::size_t align = alignment) {
+            void *p = allocate(size, align);
+            if (unlikely(p == nullptr)) {
+                throw std::bad_alloc();
+            }
+            return p;
+        }
+    }
+}
+
+using namespace tf;
+
+extern "C" {
+
+void *malloc(std::size_t size) noexcept {
+    return arena_malloc::allocate_or_enomem(size);
+}
+
+void free(void *p) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void *calloc(std::size_t count, std::size_t size) noexcept {
+    std::size_t total;
+    if (__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    void *p = arena_malloc::allocate_or_enomem(total);
+    if (p != nullptr) {
+        std::memset(p, 0, total);
+    }
+    return p;
+}
+
+void *realloc(void *p, std::size_t size) noexcept {
+    if (p != nullptr && size == 0) {
+        arena_malloc::deallocate(p);
+        return nullptr;
+    }
+    void *n = arena_malloc::reallocate(p, size);
+    if (n == nullptr) {
+        errno = ENOMEM;
+    }
+    return n;
+}
+
+int posix_memalign(void **out, std::size_t align, std::size_t size) noexcept {
+    if (!arena_malloc::valid_alignment(align)) {
+        return EINVAL;
+    }
+    void *p = arena_malloc::allocate(size, std::max(align, arena_malloc::alignment));
+    if (p == nullptr) {
+        return ENOMEM;
+    }
+    *out = p;
+    return 0;
+}
+
+// unlike posix_memalign, alignments smaller than a pointer are fine, every block is 16 byte aligned anyway
+void *aligned_alloc(std::size_t align, std::size_t size) noexcept {
+    if (!arena_malloc::power_of_two(align)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return arena_malloc::allocate_or_enomem(size, std::max(align, arena_malloc::alignment));
+}
+
+void *memalign(std::size_t align, std::size_t size) noexcept {
+    if (!arena_malloc::power_of_two(align)) {
+        errno = EINVAL;
+        return nullptr;
+    }
+    return arena_malloc::allocate_or_enomem(size, std::max(align, arena_malloc::alignment));
+}
+
+void *valloc(std::size_t size) noexcept {
+    return arena_malloc::allocate_or_enomem(size, static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)));
+}
+
+void *pvalloc(std::size_t size) noexcept {
+    const std::size_t page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return arena_malloc::allocate_or_enomem(arena_malloc::align_up(size, page), page);
+}
+
+std::size_t malloc_usable_size(void *p) noexcept {
+    return p == nullptr ? 0 : arena_malloc::block_header::from(p)->usable();
+}
+
+}
+
+void *operator new(std::size_t size) {
+    return arena_malloc::allocate_or_throw(size);
+}
+
+void *operator new[](std::size_t size) {
+    return arena_malloc::allocate_or_throw(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return arena_malloc::allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return arena_malloc::allocate(size);
+}
+
+void operator delete(void *p) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+#if defined(__cpp_aligned_new)
+void *operator new(std::size_t size, std::align_val_t align) {
+    return arena_malloc::allocate_or_throw(size, std::max(static_cast<std::size_t>(align), arena_malloc::alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align) {
+    return arena_malloc::allocate_or_throw(size, std::max(static_cast<std::size_t>(align), arena_malloc::alignment));
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return arena_malloc::allocate(size, std::max(static_cast<std::size_t>(align), arena_malloc::alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept {
+    return arena_malloc::allocate(size, std::max(static_cast<std::size_t>(align), arena_malloc::alignment));
+}
+
+void operator delete(void *p, std::align_val_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p, std::align_val_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete(void *p, std::size_t, std::align_val_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p, std::size_t, std::align_val_t) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    arena_malloc::deallocate(p);
+}
+
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept {
+    arena_malloc::deallocate(p);
+}
+#endif
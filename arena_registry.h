@@ -0,0 +1,354 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_ARENA_REGISTRY_H
+#define FASTPATH_ARENA_REGISTRY_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "buddy_arena.h"
+#include "fast_linear_allocator.h"
+#include "lock_policy.h"
+#include "tlsf_arena.h"
+
+namespace tf {
+
+    // Arena instances chosen at start-up from a configuration, rather than baked into
+    // every call site's template arguments. The configuration has one directive a line,
+    // '#' starting a comment:
+    //   arena <name> <kind> [<initial size>]   an arena instance, kind one of arena, tlsf or buddy
+    //   type <tag> <name>                      allocators made for 'tag' use arena 'name'
+    //   size <min> <max> <name>                requests of [min, max) bytes, from allocators whose
+    //                                          tag has no type line, use arena 'name'
+    //   default <name>                         everything else, 'system' if not given
+    // 'system' is always there and is ::operator new. Size lines are tried in order.
+    //
+    // Each slot calls its arena through a switch on its kind, which the compiler
+    // inlines, so an allocation costs one predictable branch over the arena's own.
+    // Configure once, before any allocator is made; Lock guards each arena, see
+    // lock_policy.h. new_arena and epoch_arena are left out, as one keeps per-thread
+    // state shared by every instance and the other needs its epochs advanced.
+    template <typename Lock = null_lock> class arena_registry {
+    public:
+        using value_type = unsigned char;
+        using pointer = value_type*;
+
+        enum class kind { system, linear, tlsf, buddy };
+
+        using linear_type = linear_arena<fixed_growth, Lock>;
+        using tlsf_type = tlsf_arena<fixed_growth, Lock>;
+        using buddy_type = buddy_arena<Lock>;
+
+        class slot {
+            std::string m_name;
+            kind m_kind;
+            void *m_arena;
+
+        public:
+            slot(const std::string &name, kind k, std::size_t initial_size) : m_name(name), m_kind(k), m_arena(nullptr) {
+                switch (m_kind) {
+                    case kind::system:
+                        break;
+                    case kind::linear:
+                        m_arena = new linear_type(initial_size);
+                        break;
+                    case kind::tlsf:
+                        m_arena = new tlsf_type(initial_size);
+                        break;
+                    case kind::buddy:
+                        m_arena = new buddy_type(initial_size);
+                        break;
+                }
+            }
+
+            ~slot() {
+                switch (m_kind) {
+                    case kind::system:
+                        break;
+                    case kind::linear:
+                        delete static_cast<linear_type *>(m_arena);
+                        break;
+                    case kind::tlsf:
+                        delete static_cast<tlsf_type *>(m_arena);
+                        break;
+                    case kind::buddy:
+                        delete static_cast<buddy_type *>(m_arena);
+                        break;
+                }
+            }
+
+            slot(const slot &) = delete;
+            slot &operator=(const slot &) = delete;
+
+            const std::string &name() const noexcept { return m_name; }
+            kind arena_kind() const noexcept { return m_kind; }
+
+            inline pointer allocate(std::size_t size) const {
+                switch (m_kind) {
+                    case kind::linear:
+                        return static_cast<linear_type *>(m_arena)->allocate(size);
+                    case kind::tlsf:
+                        return static_cast<tlsf_type *>(m_arena)->allocate(size);
+                    case kind::buddy:
+                        return static_cast<buddy_type *>(m_arena)->allocate(size);
+                    case kind::system:
+                        break;
+                }
+                return static_cast<pointer>(::operator new(size));
+            }
+
+            inline void deallocate(pointer p, std::size_t size) const noexcept {
+                switch (m_kind) {
+                    case kind::linear:
+                        static_cast<linear_type *>(m_arena)->deallocate(p, size);
+                        return;
+                    case kind::tlsf:
+                        static_cast<tlsf_type *>(m_arena)->deallocate(p, size);
+                        return;
+                    case kind::buddy:
+                        static_cast<buddy_type *>(m_arena)->deallocate(p, size);
+                        return;
+                    case kind::system:
+                        break;
+                }
+                ::operator delete(p);
+            }
+        };
+
+    private:
+        struct type_route {
+            std::string m_tag;
+            const slot *m_slot;
+        };
+
+        struct size_route {
+            std::size_t m_min;
+            std::size_t m_max;
+            const slot *m_slot;
+        };
+
+        std::vector<std::unique_ptr<slot>> m_slots;
+        std::vector<type_route> m_types;
+        std::vector<size_route> m_sizes;
+        const slot *m_default;
+
+        static std::string at_line(std::size_t number) {
+            return "arena_registry: line " + std::to_string(number) + ": ";
+        }
+
+        static kind parse_kind(const std::string &name, std::size_t number) {
+            if (name == "arena") {
+                return kind::linear;
+            } else if (name == "tlsf") {
+                return kind::tlsf;
+            } else if (name == "buddy") {
+                return kind::buddy;
+            }
+            throw std::runtime_error(at_line(number) + "unknown arena kind '" + name + "'");
+        }
+
+        const slot &existing(const std::string &name, std::size_t number) const {
+            if (const slot *s = find(name)) {
+                return *s;
+            }
+            throw std::runtime_error(at_line(number) + "no arena named '" + name + "'");
+        }
+
+    public:
+        arena_registry() : m_default(nullptr) {
+            m_slots.emplace_back(new slot("system", kind::system, 0));
+            m_default = m_slots.front().get();
+        }
+
+        explicit arena_registry(const std::string &config) : arena_registry() {
+            configure(config);
+        }
+
+        arena_registry(const arena_registry &) = delete;
+        arena_registry &operator=(const arena_registry &) = delete;
+
+        // add the directives in 'config' to what is already configured
+        void configure(const std::string &config) {
+            std::istringstream lines(config);
+            std::string line;
+            for (std::size_t number = 1; std::getline(lines, line); ++number) {
+                std::istringstream words(line.substr(0, line.find('#')));
+                std::string directive;
+                if (!(words >> directive)) {
+                    continue;
+                }
+
+                std::string name;
+                std::string target;
+                bool valid = true;
+                if (directive == "arena") {
+                    std::string k;
+                    std::size_t initial_size = 1024 * 1024;
+                    valid = static_cast<bool>(words >> name >> k);
+                    if (valid && !(words >> initial_size)) {
+                        valid = words.eof();
+                    }
+                    if (valid) {
+                        if (find(name) != nullptr) {
+                            throw std::runtime_error(at_line(number) + "arena '" + name + "' is already defined");
+                        }
+                        m_slots.emplace_back(new slot(name, parse_kind(k, number), initial_size));
+                    }
+                } else if (directive == "type") {
+                    valid = static_cast<bool>(words >> name >> target);
+                    if (valid) {
+                        m_types.push_back({name, &existing(target, number)});
+                    }
+                } else if (directive == "size") {
+                    std::size_t min = 0;
+                    std::size_t max = 0;
+                    valid = static_cast<bool>(words >> min >> max >> target);
+                    if (valid) {
+                        m_sizes.push_back({min, max, &existing(target, number)});
+                    }
+                } else if (directive == "default") {
+                    valid = static_cast<bool>(words >> target);
+                    if (valid) {
+                        m_default = &existing(target, number);
+                    }
+                } else {
+                    valid = false;
+                }
+
+                std::string extra;
+                if (!valid || words >> extra) {
+                    throw std::runtime_error(at_line(number) + "cannot parse '" + line + "'");
+                }
+            }
+        }
+
+        // the arena called 'name', or nullptr
+        const slot *find(const std::string &name) const noexcept {
+            for (const auto &s : m_slots) {
+                if (s->name() == name) {
+                    return s.get();
+                }
+            }
+            return nullptr;
+        }
+
+        // the arena configured for 'tag', or nullptr if its requests are routed by size
+        const slot *route(const std::string &tag) const noexcept {
+            for (const type_route &r : m_types) {
+                if (r.m_tag == tag) {
+                    return r.m_slot;
+                }
+            }
+            return nullptr;
+        }
+
+        // the arena for a request of 'size' bytes that no type line has claimed
+        inline const slot *route(std::size_t size) const noexcept {
+            for (const size_route &r : m_sizes) {
+                if (r.m_min <= size && size < r.m_max) {
+                    return r.m_slot;
+                }
+            }
+            return m_default;
+        }
+
+        // every arena, 'system' first and the rest in the order they were configured
+        std::vector<const slot *> slots() const {
+            std::vector<const slot *> result;
+            for (const auto &s : m_slots) {
+                result.push_back(s.get());
+            }
+            return result;
+        }
+    };
+
+    // An allocator taking its memory from whichever arena a registry has configured:
+    // the one for its tag, fixed when it is made, or else the one for each request's size.
+    // Rebinding keeps the arena, so a container's nodes come from its element type's.
+    template <typename T, typename Registry = arena_registry<>> class registry_allocator {
+    public:
+        typedef T value_type;
+        typedef value_type* pointer;
+        typedef const value_type* const_pointer;
+        typedef value_type& reference;
+        typedef const value_type& const_reference;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        using registry_type = Registry;
+        using slot_type = typename Registry::slot;
+
+    private:
+        Registry *m_registry;
+        // nullptr when requests are routed by size
+        const slot_type *m_slot;
+
+        template <typename U, typename R> friend class registry_allocator;
+
+        inline const slot_type &slot_for(std::size_t bytes) const noexcept {
+            return m_slot != nullptr ? *m_slot : *m_registry->route(bytes);
+        }
+
+    public:
+        template<typename U> struct rebind {
+            typedef registry_allocator<U, Registry> other;
+        };
+
+        registry_allocator(Registry &registry, const std::string &tag) noexcept : m_registry(&registry), m_slot(registry.route(tag)) {}
+
+        // pinned to one arena, whatever the configuration routes
+        registry_allocator(Registry &registry, const slot_type &slot) noexcept : m_registry(&registry), m_slot(&slot) {}
+
+        template <typename U> registry_allocator(const registry_allocator<U, Registry> &other) noexcept : m_registry(other.m_registry), m_slot(other.m_slot) {}
+
+        inline pointer allocate(const std::size_t size) {
+            const std::size_t bytes = size * sizeof(T);
+            return reinterpret_cast<pointer>(slot_for(bytes).allocate(bytes));
+        }
+
+        inline void deallocate(T* p, std::size_t size) noexcept {
+            const std::size_t bytes = size * sizeof(T);
+            slot_for(bytes).deallocate(reinterpret_cast<typename Registry::pointer>(p), bytes);
+        }
+
+        // the arena the allocator is fixed to, nullptr when it routes by size
+        const slot_type *arena_slot() const noexcept { return m_slot; }
+
+        template <typename U> bool operator==(const registry_allocator<U, Registry> &other) const noexcept {
+            return m_registry == other.m_registry && m_slot == other.m_slot;
+        }
+
+        template <typename U> bool operator!=(const registry_allocator<U, Registry> &other) const noexcept {
+            return !(*this == other);
+        }
+    };
+}
+
+#endif //FASTPATH_ARENA_REGISTRY_H
@@ -0,0 +1,145 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_ARENA_STRING_H
+#define FASTPATH_ARENA_STRING_H
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+#include "small_vector.h"
+
+namespace tf {
+
+    // A string with N bytes of inline storage (including the terminator), spilling
+    // into an allocator beyond that. Appending to a spilled string extends its
+    // block in place while it is the last allocation in the arena, which is the
+    // usual case while a string is being built up.
+    template <typename Allocator = linear_allocator<char>, std::size_t N = 32> class basic_arena_string {
+    public:
+        using value_type = char;
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+        using iterator = char *;
+        using const_iterator = const char *;
+
+    private:
+        // always holds a trailing '\0', so c_str() is free
+        small_vector<char, N, Allocator> m_chars;
+
+    public:
+        explicit basic_arena_string(const allocator_type &allocator) : m_chars(allocator) {
+            m_chars.push_back('\0');
+        }
+
+        basic_arena_string(const char *s, size_type length, const allocator_type &allocator) : m_chars(allocator) {
+            m_chars.reserve(length + 1);
+            m_chars.append(s, s + length);
+            m_chars.push_back('\0');
+        }
+
+        basic_arena_string(const char *s, const allocator_type &allocator) : basic_arena_string(s, std::strlen(s), allocator) {}
+
+        basic_arena_string(basic_arena_string &&other) : m_chars(std::move(other.m_chars)) {
+            other.m_chars.push_back('\0');
+        }
+
+        basic_arena_string(const basic_arena_string &) = delete;
+        basic_arena_string &operator=(const basic_arena_string &) = delete;
+
+        basic_arena_string &append(const char *s, size_type length) {
+            m_chars.pop_back();
+            m_chars.append(s, s + length);
+            m_chars.push_back('\0');
+            return *this;
+        }
+
+        basic_arena_string &append(const char *s) { return append(s, std::strlen(s)); }
+        basic_arena_string &append(tf::span<const char> s) { return append(s.data(), s.size()); }
+
+        basic_arena_string &push_back(char c) {
+            m_chars.back() = c;
+            m_chars.push_back('\0');
+            return *this;
+        }
+
+        basic_arena_string &operator+=(char c) { return push_back(c); }
+        basic_arena_string &operator+=(const char *s) { return append(s); }
+        basic_arena_string &operator+=(tf::span<const char> s) { return append(s); }
+        basic_arena_string &operator+=(const basic_arena_string &s) { return append(s.data(), s.size()); }
+
+        void reserve(size_type length) { m_chars.reserve(length + 1); }
+
+        void clear() {
+            m_chars.clear();
+            m_chars.push_back('\0');
+        }
+
+        size_type size() const noexcept { return m_chars.size() - 1; }
+        size_type length() const noexcept { return size(); }
+        size_type capacity() const noexcept { return m_chars.capacity() - 1; }
+        bool empty() const noexcept { return size() == 0; }
+        bool is_inline() const noexcept { return m_chars.is_inline(); }
+
+        const char *data() const noexcept { return m_chars.data(); }
+        char *data() noexcept { return m_chars.data(); }
+        const char *c_str() const noexcept { return m_chars.data(); }
+
+        char &operator[](size_type i) noexcept { return m_chars[i]; }
+        const char &operator[](size_type i) const noexcept { return m_chars[i]; }
+
+        iterator begin() noexcept { return m_chars.begin(); }
+        iterator end() noexcept { return m_chars.begin() + size(); }
+        const_iterator begin() const noexcept { return m_chars.begin(); }
+        const_iterator end() const noexcept { return m_chars.begin() + size(); }
+
+        // the characters without copying, valid until the string is next modified
+        tf::span<const char> view() const noexcept { return tf::span<const char>(data(), size()); }
+
+#if __cplusplus >= 201703L
+        operator std::string_view() const noexcept { return std::string_view(data(), size()); }
+#endif
+
+        bool operator==(tf::span<const char> other) const noexcept {
+            return size() == other.size() && std::memcmp(data(), other.data(), size()) == 0;
+        }
+
+        bool operator!=(tf::span<const char> other) const noexcept { return !(*this == other); }
+
+        bool operator==(const basic_arena_string &other) const noexcept { return *this == other.view(); }
+        bool operator!=(const basic_arena_string &other) const noexcept { return !(*this == other.view()); }
+
+        friend std::ostream &operator<<(std::ostream &out, const basic_arena_string &s) {
+            return out.write(s.data(), static_cast<std::streamsize>(s.size()));
+        }
+    };
+
+    using arena_string = basic_arena_string<>;
+}
+
+#endif //FASTPATH_ARENA_STRING_H
@@ -0,0 +1,60 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_ARENA_TRAITS_H
+#define FASTPATH_ARENA_TRAITS_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace tf {
+
+    namespace detail {
+        template <typename...> struct make_void { using type = void; };
+        template <typename... Ts> using void_t = typename make_void<Ts...>::type;
+    }
+
+    // The Arena concept, which linear_allocator and deferred_free check their Arena
+    // against: a pointer type, allocate(size) returning one, and a deallocate(pointer,
+    // size) that cannot throw, as it is called from allocator deallocate and destructors.
+    template <typename A, typename = void> struct is_arena : std::false_type {};
+
+    template <typename A> struct is_arena<A, detail::void_t<typename A::pointer,
+                                                            decltype(std::declval<A &>().allocate(std::size_t())),
+                                                            decltype(std::declval<A &>().deallocate(std::declval<typename A::pointer>(), std::size_t()))>>
+        : std::integral_constant<bool, std::is_same<decltype(std::declval<A &>().allocate(std::size_t())), typename A::pointer>::value &&
+                                       noexcept(std::declval<A &>().deallocate(std::declval<typename A::pointer>(), std::size_t()))> {};
+
+    // Arenas that can also resize a block in place, as linear_allocator's expand and
+    // reallocate need.
+    template <typename A, typename = void> struct is_resizable_arena : std::false_type {};
+
+    template <typename A> struct is_resizable_arena<A, detail::void_t<decltype(std::declval<A &>().try_expand(std::declval<typename A::pointer>(), std::size_t(), std::size_t())),
+                                                                      decltype(std::declval<A &>().reallocate(std::declval<typename A::pointer>(), std::size_t(), std::size_t()))>>
+        : is_arena<A> {};
+}
+
+#endif //FASTPATH_ARENA_TRAITS_H
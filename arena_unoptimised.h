@@ -23,157 +23,16 @@
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
  ***************************************************************************/
 
-#ifndef FASTPATH_FAST_LINEAR_ALLOCATOR2_H
-#define FASTPATH_FAST_LINEAR_ALLOCATOR2_H
+#ifndef FASTPATH_ARENA_UNOPTIMISED_H
+#define FASTPATH_ARENA_UNOPTIMISED_H
 
-#include <cstddef>
-#include <cassert>
+#include "basic_arena.h"
 
 namespace tf {
 
-    class arena_unoptimised {
-    public:
-        using pointer = unsigned char *;
-        using value_type = pointer;
-
-    private:
-        struct slab {
-            pointer m_content;
-            std::size_t m_size;
-            std::size_t m_allocated;
-            pointer m_head;
-            slab *m_next;
-
-            static std::size_t align_up(std::size_t n) noexcept {
-                static const size_t alignment = 16;
-                return (n + (alignment - 1)) & ~(alignment - 1);
-            }
-
-            inline bool pointer_in_buffer(pointer p) const noexcept {
-                return m_content <= p && p <= m_head;
-            }
-
-            slab(std::size_t size) noexcept : m_size(size), m_allocated(0), m_next(nullptr) {
-                m_content = reinterpret_cast<pointer>(::malloc(align_up(m_size)));
-                m_head = m_content;
-            }
-
-            ~slab() noexcept {
-                ::free(m_content);
-            }
-
-            std::size_t free() const noexcept {
-                return m_size - std::distance(m_content, m_head);
-            }
-
-            pointer allocate(std::size_t size) noexcept {
-                assert(this->free() >= size);
-                pointer p = m_head;
-                std::advance(m_head, size);
-                m_allocated += size; //std::distance(m_content, m_head);
-                return p;
-            }
-
-            void deallocate(pointer ptr, std::size_t size) noexcept {
-                assert(pointer_in_buffer(ptr));
-                m_allocated -= size;
-                assert(m_allocated >= 0);
-                if (m_allocated == 0) {
-                    m_head = m_content;
-                } else if (ptr + size == m_head) {
-                    m_head = ptr;
-                }
-                //m_allocated = std::distance(m_content, m_head);
-            }
-        };
-
-        std::size_t m_initial_size;
-
-        slab *m_root_slab;
-        slab *m_current_slab;
-
-        inline slab *find_slab_with_space(slab *start, std::size_t size) const noexcept {
-            if (start->free() >= size) {
-                return start;
-            } else if (start->m_next != nullptr) {
-                return find_slab_with_space(start->m_next, size);
-            }
-
-            return nullptr;
-        }
-
-        inline slab *find_slab_containing(slab *start, pointer ptr) const noexcept {
-            if (start->pointer_in_buffer(ptr)) {
-                return start;
-            } else if (start->m_next != nullptr) {
-                return find_slab_containing(start->m_next, ptr);
-            }
-
-            return nullptr;
-        }
-
-    public:
-        ~arena_unoptimised() {
-            slab *s = m_root_slab;
-            while (s != nullptr) {
-                s = s->m_next;
-                delete s;
-            }
-            m_root_slab = nullptr;
-        }
-
-        arena_unoptimised(std::size_t initial_size = 1024) noexcept : m_initial_size(initial_size),
-                                                                      m_root_slab(new slab(initial_size)) {
-            m_current_slab = m_root_slab;
-        }
-
-        arena_unoptimised(const arena_unoptimised &) = delete;
-
-        arena_unoptimised &operator=(const arena_unoptimised &) = delete;
-
-        arena_unoptimised::pointer allocate(std::size_t size) {
-            slab *s = nullptr;
-            if ((s = find_slab_with_space(m_root_slab, size)) != nullptr) {
-                return s->allocate(size);
-            } else {
-                m_current_slab->m_next = new slab(std::max(size, m_initial_size));
-                m_current_slab = m_current_slab->m_next;
-                return m_current_slab->allocate(size);
-            }
-        }
-
-        void deallocate(arena_unoptimised::pointer p, std::size_t size) noexcept {
-            slab *s = find_slab_containing(m_root_slab, p);
-            assert(s != nullptr);
-            if (s != nullptr) {
-                s->deallocate(p, size);
-            }
-        }
-
-        friend std::ostream &operator<<(std::ostream &out, const arena_unoptimised &a) {
-            std::size_t block_count = 0;
-            std::size_t total_free = 0;
-            std::size_t total_capacity = 0;
-            std::size_t total_allocated = 0;
-
-            std::function<void(const slab *)> totals = [&](const slab *start) {
-                block_count++;
-                total_free += start->free();
-                total_capacity += start->m_size;
-                total_allocated += start->m_allocated;
-                if (start->m_next != nullptr) {
-                    totals(start->m_next);
-                }
-            };
-
-            totals(a.m_root_slab);
-
-            out << "allocated: " << total_allocated << " capacity: " << total_capacity << " allocatable: " <<
-            total_free << " from " << block_count << " blocks";
-            return out;
-        }
-
-    };
+    // The baseline: every slab from malloc, and every allocation and free walking the
+    // chain from the first slab
+    using arena_unoptimised = basic_arena<malloc_slabs, fixed_growth, chain_lookup, null_lock, no_stats>;
 }
-#endif //FASTPATH_FAST_LINEAR_ALLOCATOR_H
 
+#endif //FASTPATH_ARENA_UNOPTIMISED_H
@@ -0,0 +1,641 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_BASIC_ARENA_H
+#define FASTPATH_BASIC_ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <type_traits>
+#include <utility>
+#include "allocation_profiler.h"
+#include "lock_policy.h"
+#include "optimize.h"
+#include "slab_growth.h"
+#include "slab_memory.h"
+#include "zero_fill.h"
+
+namespace tf {
+
+    // SlabSource policies: the size a slab asked for really gets, and the commit policy
+    // (mmap or malloc, and whether untouched pages are handed back, see slab_memory.h)
+    // an arena uses unless it is given another.
+
+    // reserved with mmap above the commit policy's threshold, pages handed back as the bump pointer falls
+    struct mapped_slabs {
+        static std::size_t slab_size(std::size_t size) noexcept { return size; }
+        static commit_policy policy() noexcept { return commit_policy(); }
+    };
+
+    // every slab from malloc, exactly the size asked for
+    struct malloc_slabs {
+        static std::size_t slab_size(std::size_t size) noexcept { return size; }
+        static commit_policy policy() noexcept { return commit_policy::never(); }
+    };
+
+    // every slab from malloc, rounded up to a power of two
+    struct pow2_malloc_slabs {
+        static std::size_t slab_size(std::size_t size) noexcept { return round_up_pow2(size); }
+        static commit_policy policy() noexcept { return commit_policy::never(); }
+    };
+
+    // Lookup policies: with_space() finds a slab with room for 'size' bytes, or returns
+    // nullptr for the arena to grow, and containing() the slab a block was carved from.
+
+    // always walks the chain from the first slab
+    struct chain_lookup {
+        template <typename Slab> static inline Slab *with_space(Slab *root, Slab *, std::size_t size) noexcept {
+            for (Slab *s = root; s != nullptr; s = s->m_next) {
+                if (s->free() >= size) {
+                    return s;
+                }
+            }
+            return nullptr;
+        }
+
+        template <typename Slab, typename P> static inline Slab *containing(Slab *root, Slab *, P p) noexcept {
+            for (Slab *s = root; s != nullptr; s = s->m_next) {
+                if (s->pointer_in_buffer(p)) {
+                    return s;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    // tries the slab most recently added first, where nearly every allocation and most
+    // frees land, before walking the chain
+    struct current_slab_lookup {
+        template <typename Slab> static inline Slab *with_space(Slab *root, Slab *current, std::size_t size) noexcept {
+            if (likely(current->free() >= size)) {
+                return current;
+            }
+            return chain_lookup::with_space(root, current, size);
+        }
+
+        template <typename Slab, typename P> static inline Slab *containing(Slab *root, Slab *current, P p) noexcept {
+            if (likely(current->pointer_in_buffer(p))) {
+                return current;
+            }
+            return chain_lookup::containing(root, current, p);
+        }
+    };
+
+    // Stats policies, called under the arena's lock. Resizing in place reports the old
+    // size freed and the new one allocated, as zero blocks.
+
+    struct no_stats {
+        inline void on_slab(std::size_t) noexcept {}
+        inline void on_allocate(std::size_t, std::size_t) noexcept {}
+        inline void on_deallocate(std::size_t, std::size_t) noexcept {}
+    };
+
+    // byte counts are as requested, before rounding up to the arena's alignment
+    struct counting_stats {
+        std::size_t m_slabs = 0;
+        std::size_t m_slab_bytes = 0;
+        std::size_t m_allocations = 0;
+        std::size_t m_deallocations = 0;
+        std::size_t m_live_bytes = 0;
+        std::size_t m_peak_live_bytes = 0;
+
+        inline void on_slab(std::size_t size) noexcept {
+            m_slabs++;
+            m_slab_bytes += size;
+        }
+
+        inline void on_allocate(std::size_t size, std::size_t blocks) noexcept {
+            m_allocations += blocks;
+            m_live_bytes += size;
+            m_peak_live_bytes = std::max(m_peak_live_bytes, m_live_bytes);
+        }
+
+        inline void on_deallocate(std::size_t size, std::size_t blocks) noexcept {
+            m_deallocations += blocks;
+            m_live_bytes -= size;
+        }
+    };
+
+    // A bump allocator over a chain of slabs, put together from policies:
+    //   SlabSource  how big each slab really is and where its memory comes from
+    //   Growth      the size asked for each new slab, see slab_growth.h
+    //   Lookup      how the slab to allocate from, and the one owning a freed block, are found
+    //   Sync        guards every operation, so with anything but null_lock the arena can
+    //               be shared between threads, see lock_policy.h
+    //   Stats       what the arena counts as it goes
+    // tf::arena, tf::arena_unoptimised and tf::optimised_arena are each one combination.
+    template <typename SlabSource = mapped_slabs, typename Growth = fixed_growth, typename Lookup = current_slab_lookup, typename Sync = null_lock, typename Stats = no_stats> class basic_arena {
+    public:
+        using value_type = unsigned char;
+        using pointer = value_type*;
+
+    private:
+        // Each slab header fills exactly one cache line, with the fields every allocation
+        // touches first. Headers are packed together in slab_chunks rather than allocated
+        // one by one, see below.
+        struct alignas(64) slab {
+            pointer m_head;
+            std::size_t m_allocated;
+            pointer m_content;
+            std::size_t m_size;
+            slab *m_next;
+            // end of the pages the bump pointer may have touched, see slab_memory.h
+            pointer m_dirty;
+            // everything from here (or from m_head, if that is higher) up is still zero:
+            // the whole of a slab fresh from mmap, none of one from malloc
+            pointer m_clean;
+            bool m_mapped;
+            // mlock'ed by a warm_up, so never trimmed and unlocked before it is freed
+            bool m_locked;
+
+            // zero byte blocks still take one unit, so each is a distinct address inside its slab
+            static inline std::size_t align_up(std::size_t n) noexcept {
+                static const size_t alignment = 16;
+                return (std::max<std::size_t>(n, 1) + (alignment-1)) & ~(alignment-1);
+            }
+
+            // the whole reservation, not just up to m_head: when a full slab's mapping
+            // happens to end where another slab's begins, its m_head is the other
+            // slab's first block
+            inline bool pointer_in_buffer(pointer p) const noexcept {
+                return m_content <= p && p < m_content + m_size;
+            }
+
+            slab(std::size_t size, const commit_policy &policy, warm_up::prefault_mode prefault) : m_allocated(0), m_size(size), m_next(nullptr), m_locked(false) {
+                m_content = static_cast<pointer>(slab_memory::allocate(size, 16, policy, m_mapped, prefault));
+                m_head = m_content;
+                m_dirty = m_content;
+                m_clean = m_mapped ? m_content : m_content + m_size;
+            }
+
+            ~slab() noexcept {
+                if (m_locked) {
+                    slab_memory::unlock(m_content, m_size);
+                }
+                slab_memory::deallocate(m_content, m_size, m_mapped);
+            }
+
+            inline void lower_head(pointer head) noexcept {
+                if (m_head > m_dirty) {
+                    m_dirty = m_head;
+                }
+                if (m_head > m_clean) {
+                    m_clean = m_head;
+                }
+                m_head = head;
+            }
+
+            // hand back pages well above the bump pointer once it has fallen back
+            inline void trim(const commit_policy &policy) noexcept {
+                if (unlikely(m_mapped) && !m_locked) {
+                    const pointer dirty = slab_memory::trim(m_head, m_dirty, policy);
+                    if (dirty != m_dirty && slab_memory::releases_zeroed(policy) && slab_memory::page_up(m_dirty) >= m_clean) {
+                        m_clean = dirty;
+                    }
+                    m_dirty = dirty;
+                }
+            }
+
+            inline std::size_t free() const noexcept {
+                return m_size - std::distance(m_content, m_head);
+            }
+
+            inline pointer allocate(std::size_t size) noexcept {
+                size = align_up(size);
+                assert(this->free() >= size);
+                pointer p = m_head;
+                std::advance(m_head, size);
+                m_allocated += size;
+                return p;
+            }
+
+            // as allocate, also counting how many of the block's first 'size' bytes may not be zero
+            inline pointer allocate_clean(std::size_t size, std::size_t &dirty) noexcept {
+                pointer p = allocate(size);
+                dirty = m_clean > p ? std::min(static_cast<std::size_t>(m_clean - p), size) : 0;
+                return p;
+            }
+
+            inline void deallocate(pointer ptr, std::size_t size) noexcept {
+                assert(pointer_in_buffer(ptr));
+                size = align_up(size);
+                if ((m_allocated -= size) == 0) {
+                    lower_head(m_content);
+                } else if (ptr + size == m_head) {
+                    lower_head(ptr);
+                }
+            }
+
+            template <typename P> inline void allocate_n(std::size_t size, std::size_t count, P *out) noexcept {
+                size = align_up(size);
+                assert(this->free() >= size * count);
+                pointer p = m_head;
+                for (std::size_t i = 0; i < count; ++i) {
+                    out[i] = reinterpret_cast<P>(p);
+                    p += size;
+                }
+                m_head = p;
+                m_allocated += size * count;
+            }
+
+            // release a run of blocks totalling 'size' (already aligned) bytes, the lowest of which is at 'lowest'
+            inline void deallocate_run(pointer lowest, std::size_t size) noexcept {
+                assert(pointer_in_buffer(lowest));
+                if ((m_allocated -= size) == 0) {
+                    lower_head(m_content);
+                } else if (lowest + size == m_head) {
+                    lower_head(lowest);
+                }
+            }
+
+            // release blocks of any sizes, all in this slab and sorted by address: the count
+            // once, then the bump pointer back past however many of them end where it stands
+            inline void deallocate_sorted(const std::pair<pointer, std::size_t> *first, const std::pair<pointer, std::size_t> *last) noexcept {
+                std::size_t size = 0;
+                for (const std::pair<pointer, std::size_t> *b = first; b != last; ++b) {
+                    assert(pointer_in_buffer(b->first));
+                    size += align_up(b->second);
+                }
+                if ((m_allocated -= size) == 0) {
+                    lower_head(m_content);
+                    return;
+                }
+                pointer head = m_head;
+                while (last != first && (last - 1)->first + align_up((last - 1)->second) == head) {
+                    --last;
+                    head = last->first;
+                }
+                if (head != m_head) {
+                    lower_head(head);
+                }
+            }
+
+            // grow or shrink the block at 'ptr' without moving it, sizes are already aligned
+            inline bool try_expand(pointer ptr, std::size_t old_size, std::size_t new_size) noexcept {
+                assert(pointer_in_buffer(ptr));
+                if (ptr + old_size == m_head) {
+                    if (new_size > old_size && static_cast<std::size_t>(m_content + m_size - ptr) < new_size) {
+                        return false;
+                    }
+                    lower_head(ptr + new_size);
+                } else if (new_size > old_size) {
+                    return false;
+                }
+                m_allocated = m_allocated - old_size + new_size;
+                return true;
+            }
+        };
+
+        static_assert(sizeof(slab) == 64, "the slab header should fill exactly one cache line");
+
+        // A page of slab headers. The arena never frees a slab before it is destroyed,
+        // so headers are handed out in order and the Lookup's chain walks stream
+        // through consecutive lines, rather than visiting one scattered heap object
+        // per slab.
+        struct alignas(64) slab_chunk {
+            static constexpr std::size_t capacity = 63;
+
+            typename std::aligned_storage<sizeof(slab), alignof(slab)>::type m_slabs[capacity];
+            slab_chunk *m_next;
+            std::size_t m_used;
+        };
+
+        std::size_t m_initial_size;
+        commit_policy m_policy;
+        Growth m_growth;
+        mutable Sync m_lock;
+        Stats m_stats;
+
+        slab_chunk *m_chunks;
+        slab *m_root_slab;
+        slab *m_current_slab;
+
+        slab *new_slab(std::size_t size, warm_up::prefault_mode prefault = warm_up::no_prefault) {
+            if (m_chunks == nullptr || m_chunks->m_used == slab_chunk::capacity) {
+                void *p = nullptr;
+                if (::posix_memalign(&p, alignof(slab_chunk), sizeof(slab_chunk)) != 0) {
+                    throw std::bad_alloc();
+                }
+                slab_chunk *chunk = static_cast<slab_chunk *>(p);
+                chunk->m_next = m_chunks;
+                chunk->m_used = 0;
+                m_chunks = chunk;
+            }
+            slab *s = new (&m_chunks->m_slabs[m_chunks->m_used++]) slab(SlabSource::slab_size(size), m_policy, prefault);
+            m_stats.on_slab(s->m_size);
+            return s;
+        }
+
+        // a slab for an allocation of 'size' bytes that no existing slab has room for
+        slab *grow(std::size_t size) {
+            std::size_t live = 0;
+            if (Growth::tracks_demand) {
+                for (const slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                    live += s->m_allocated;
+                }
+            }
+            return new_slab(m_growth.next_size(size, m_initial_size, live));
+        }
+
+        // the first slab with room for 'size' (already aligned) bytes, growing the chain if none has
+        slab *slab_with_space(std::size_t size) {
+            if (slab *s = Lookup::with_space(m_root_slab, m_current_slab, size)) {
+                return s;
+            }
+            // slabs are never freed, so the current slab is always the last in the chain
+            m_current_slab->m_next = grow(size);
+            m_current_slab = m_current_slab->m_next;
+            return m_current_slab;
+        }
+
+        basic_arena(std::size_t initial_size, const commit_policy &policy, warm_up::prefault_mode prefault) : m_initial_size(initial_size), m_policy(policy), m_growth(), m_stats(), m_chunks(nullptr), m_root_slab(new_slab(initial_size, prefault)) {
+            m_current_slab = m_root_slab;
+        }
+
+    public:
+        ~basic_arena() {
+            slab *s = m_root_slab;
+            while (s != nullptr) {
+                slab *next = s->m_next;
+                s->~slab();
+                s = next;
+            }
+            m_root_slab = nullptr;
+
+            while (m_chunks != nullptr) {
+                slab_chunk *next = m_chunks->m_next;
+                ::free(m_chunks);
+                m_chunks = next;
+            }
+        }
+
+        basic_arena(std::size_t initial_size = 1024, const commit_policy &policy = SlabSource::policy()) : m_initial_size(initial_size), m_policy(policy), m_growth(), m_stats(), m_chunks(nullptr), m_root_slab(new_slab(initial_size)) {
+            m_current_slab = m_root_slab;
+        }
+
+        // as above, with the first warm.m_slabs slabs created and warmed up straight away,
+        // see warm_up in slab_memory.h
+        // (delegating, so the slabs already made are released if a later one can't be)
+        basic_arena(std::size_t initial_size, const commit_policy &policy, const warm_up &warm) : basic_arena(initial_size, policy, warm.m_prefault) {
+            for (std::size_t i = 1; i < warm.m_slabs; ++i) {
+                m_current_slab->m_next = new_slab(initial_size, warm.m_prefault);
+                m_current_slab = m_current_slab->m_next;
+            }
+            if (warm.m_lock) {
+                for (slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                    s->m_locked = slab_memory::lock(s->m_content, s->m_size);
+                }
+            }
+        }
+
+        basic_arena(const basic_arena&) = delete;
+        basic_arena& operator=(const basic_arena&) = delete;
+
+        basic_arena::pointer allocate(std::size_t size) {
+            pointer p;
+            {
+                std::lock_guard<Sync> guard(m_lock);
+                p = slab_with_space(slab::align_up(size))->allocate(size);
+                m_stats.on_allocate(size, 1);
+            }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // a block of 'size' bytes, all zero, which only needs clearing as far as the
+        // slab has been used before; the clearing is done outside the lock
+        basic_arena::pointer allocate_zeroed(std::size_t size) {
+            pointer p;
+            std::size_t dirty;
+            {
+                std::lock_guard<Sync> guard(m_lock);
+                p = slab_with_space(slab::align_up(size))->allocate_clean(size, dirty);
+                m_stats.on_allocate(size, 1);
+            }
+            if (dirty != 0) {
+                zero_fill(p, dirty);
+            }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // the same as allocate, the arenas never initialise what they hand out; for
+        // call sites to say that they will overwrite the whole block themselves
+        basic_arena::pointer allocate_uninit(std::size_t size) {
+            return allocate(size);
+        }
+
+        void deallocate(basic_arena::pointer p, std::size_t size) noexcept {
+            allocation_profiler::deallocated(p);
+            std::lock_guard<Sync> guard(m_lock);
+            slab *s = Lookup::containing(m_root_slab, m_current_slab, p);
+            assert(s != nullptr);
+            if (s != nullptr) {
+                s->deallocate(p, size);
+                s->trim(m_policy);
+                m_stats.on_deallocate(size, 1);
+            }
+        }
+
+        // fill 'out' with 'count' blocks of 'size' bytes, all carved from a single slab reservation
+        template <typename P> void allocate_n(std::size_t size, std::size_t count, P *out) {
+            std::unique_lock<Sync> guard(m_lock);
+            slab_with_space(slab::align_up(size) * count)->allocate_n(size, count, out);
+            m_stats.on_allocate(size * count, count);
+            guard.unlock();
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::allocated(this, out[i], size);
+            }
+        }
+
+        // release 'count' blocks of 'size' bytes, updating each slab once per run of pointers it contains
+        template <typename P> void deallocate_n(const P *ptrs, std::size_t size, std::size_t count) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::deallocated(ptrs[i]);
+            }
+            std::lock_guard<Sync> guard(m_lock);
+            m_stats.on_deallocate(size * count, count);
+            size = slab::align_up(size);
+            slab *s = nullptr;
+            pointer lowest = nullptr;
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                pointer p = reinterpret_cast<pointer>(ptrs[i]);
+                if (s == nullptr || !s->pointer_in_buffer(p)) {
+                    if (s != nullptr) {
+                        s->deallocate_run(lowest, run);
+                        s->trim(m_policy);
+                    }
+                    s = Lookup::containing(m_root_slab, m_current_slab, p);
+                    assert(s != nullptr);
+                    lowest = p;
+                    run = 0;
+                }
+                lowest = std::min(lowest, p);
+                run += size;
+            }
+            if (s != nullptr) {
+                s->deallocate_run(lowest, run);
+                s->trim(m_policy);
+            }
+        }
+
+        // release a batch of blocks of any sizes, reordering 'blocks' by address so that each
+        // slab's share of the batch is one run, found with a single lookup, and each slab is
+        // updated once however many of the blocks it holds, see deferred_free.h. Each lookup
+        // carries on along the chain from the slab found last, so where slabs were carved in
+        // ascending address order, as they mostly are, a flush walks the chain just once.
+        void deallocate_batch(std::pair<pointer, std::size_t> *blocks, std::size_t count) noexcept {
+            using block = std::pair<pointer, std::size_t>;
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::deallocated(blocks[i].first);
+            }
+            std::sort(blocks, blocks + count, [](const block &a, const block &b) { return a.first < b.first; });
+
+            std::lock_guard<Sync> guard(m_lock);
+            block *const end = blocks + count;
+            slab *s = nullptr;
+            for (block *first = blocks; first != end;) {
+                slab *found = s != nullptr ? Lookup::containing(s->m_next, m_current_slab, first->first) : nullptr;
+                s = found != nullptr ? found : Lookup::containing(m_root_slab, m_current_slab, first->first);
+                assert(s != nullptr);
+                if (s == nullptr) {
+                    ++first;
+                    continue;
+                }
+                block *last = first;
+                do {
+                    m_stats.on_deallocate(last->second, 1);
+                } while (++last != end && s->pointer_in_buffer(last->first));
+                s->deallocate_sorted(first, last);
+                s->trim(m_policy);
+                first = last;
+            }
+        }
+
+        bool try_expand(basic_arena::pointer p, std::size_t old_size, std::size_t new_size) noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            slab *s = Lookup::containing(m_root_slab, m_current_slab, p);
+            assert(s != nullptr);
+            if (s != nullptr && s->try_expand(p, slab::align_up(old_size), slab::align_up(new_size))) {
+                s->trim(m_policy);
+                m_stats.on_deallocate(old_size, 0);
+                m_stats.on_allocate(new_size, 0);
+                return true;
+            }
+            return false;
+        }
+
+        // resize in place when the block is the last in its slab, otherwise move it
+        basic_arena::pointer reallocate(basic_arena::pointer p, std::size_t old_size, std::size_t new_size) {
+            if (try_expand(p, old_size, new_size)) {
+                return p;
+            }
+            pointer n = allocate(new_size);
+            std::memcpy(n, p, std::min(old_size, new_size));
+            deallocate(p, old_size);
+            return n;
+        }
+
+        // bytes held in slabs, whether or not anything is allocated from them
+        std::size_t reserved_bytes() const noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            std::size_t bytes = 0;
+            for (const slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                bytes += s->m_size;
+            }
+            return bytes;
+        }
+
+        // bytes in blocks handed out, after rounding up to the arena's alignment
+        std::size_t used_bytes() const noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            std::size_t bytes = 0;
+            for (const slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                bytes += s->m_allocated;
+            }
+            return bytes;
+        }
+
+        // a snapshot of what the Stats policy has counted
+        Stats stats() const noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            return m_stats;
+        }
+
+        // bytes in slabs a warm_up managed to mlock
+        std::size_t locked_bytes() const noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            std::size_t bytes = 0;
+            for (const slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                if (s->m_locked) {
+                    bytes += s->m_size;
+                }
+            }
+            return bytes;
+        }
+
+        std::size_t slab_count() const noexcept {
+            std::lock_guard<Sync> guard(m_lock);
+            std::size_t count = 0;
+            for (const slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                count++;
+            }
+            return count;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const basic_arena &a) {
+            std::lock_guard<Sync> guard(a.m_lock);
+            std::size_t block_count = 0;
+            std::size_t total_free = 0;
+            std::size_t total_capacity = 0;
+            std::size_t total_allocated = 0;
+
+            std::function<void(const slab *)> totals = [&](const slab *start) {
+                block_count++;
+                total_free += start->free();
+                total_capacity += start->m_size;
+                total_allocated += start->m_allocated;
+                if (start->m_next != nullptr) {
+                    totals(start->m_next);
+                }
+            };
+
+            totals(a.m_root_slab);
+
+            out << "allocated: " << total_allocated << " capacity: " << total_capacity << " allocatable: " << total_free << " from " << block_count << " blocks";
+            return out;
+        }
+    };
+}
+
+#endif //FASTPATH_BASIC_ARENA_H
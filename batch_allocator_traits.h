@@ -0,0 +1,71 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_BATCH_ALLOCATOR_TRAITS_H
+#define FASTPATH_BATCH_ALLOCATOR_TRAITS_H
+
+#include <cstddef>
+#include <memory>
+
+namespace tf {
+
+    // Uses an allocator's allocate_n/deallocate_n if it provides them, otherwise
+    // falls back to one allocate/deallocate call per element.
+    template <typename A> struct batch_allocator_traits {
+        using pointer = typename std::allocator_traits<A>::pointer;
+        using size_type = typename std::allocator_traits<A>::size_type;
+
+        static void allocate_n(A &allocator, size_type size, size_type count, pointer *out) {
+            allocate_n(allocator, size, count, out, 0);
+        }
+
+        static void deallocate_n(A &allocator, const pointer *ptrs, size_type size, size_type count) {
+            deallocate_n(allocator, ptrs, size, count, 0);
+        }
+
+    private:
+        template <typename B> static auto allocate_n(B &allocator, size_type size, size_type count, pointer *out, int) -> decltype(allocator.allocate_n(size, count, out), void()) {
+            allocator.allocate_n(size, count, out);
+        }
+
+        template <typename B> static void allocate_n(B &allocator, size_type size, size_type count, pointer *out, long) {
+            for (size_type i = 0; i < count; ++i) {
+                out[i] = std::allocator_traits<B>::allocate(allocator, size);
+            }
+        }
+
+        template <typename B> static auto deallocate_n(B &allocator, const pointer *ptrs, size_type size, size_type count, int) -> decltype(allocator.deallocate_n(ptrs, size, count), void()) {
+            allocator.deallocate_n(ptrs, size, count);
+        }
+
+        template <typename B> static void deallocate_n(B &allocator, const pointer *ptrs, size_type size, size_type count, long) {
+            for (size_type i = 0; i < count; ++i) {
+                std::allocator_traits<B>::deallocate(allocator, ptrs[i], size);
+            }
+        }
+    };
+}
+
+#endif //FASTPATH_BATCH_ALLOCATOR_TRAITS_H
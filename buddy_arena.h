@@ -0,0 +1,429 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_BUDDY_ARENA_H
+#define FASTPATH_BUDDY_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include <vector>
+#include "allocation_profiler.h"
+#include "lock_policy.h"
+#include "optimize.h"
+#include "slab_growth.h"
+#include "slab_memory.h"
+
+namespace tf {
+
+    // A binary buddy arena. Each region is a power of two bytes, split in halves as
+    // often as needed down to blocks of min_block bytes; a block of order k is
+    // min_block << k bytes, and every request is rounded up to the next order. A
+    // freed block whose buddy (the other half of the block it was split from) is
+    // also free merges with it, and so on up.
+    //
+    // The free state is a bitmap per order, one bit per block of that order, kept
+    // on the heap beside the region rather than in free lists threaded through it,
+    // so a freed block is never written to or read again until it is handed out.
+    // Over each order's bitmap is a summary with one bit per 64 bit word that has
+    // any bit set, and over the orders a mask of those with any free block, so
+    // finding a block is a handful of __builtin_ctzll calls. The deallocate size
+    // gives the order, so blocks carry no header either.
+    //
+    // Rounding to a power of two can waste up to half of each block, the price of
+    // O(log n) merging with no per-block state. Requests larger than the region size
+    // get a region of their own, which is given back as soon as that block is freed.
+    template <typename Lock = null_lock> class buddy_arena {
+    public:
+        typedef unsigned char value_type;
+        typedef value_type * pointer;
+
+        static constexpr std::size_t min_block_log2 = 4;
+        static constexpr std::size_t min_block = std::size_t(1) << min_block_log2;
+
+    private:
+        static constexpr std::size_t max_orders = 48;
+
+        struct region {
+            pointer m_base;
+            std::size_t m_size;
+            std::size_t m_orders;
+            bool m_mapped;
+            region *m_next;
+            // bit k set while order k has a free block
+            std::uint64_t m_free_orders;
+            std::size_t m_free_count[max_orders];
+            // where each order's words start in m_bits, and its summary words in m_summary
+            std::size_t m_bits_offset[max_orders + 1];
+            std::size_t m_summary_offset[max_orders + 1];
+            std::vector<std::uint64_t> m_bits;
+            std::vector<std::uint64_t> m_summary;
+
+            region(pointer base, std::size_t size, bool mapped) : m_base(base), m_size(size), m_mapped(mapped), m_next(nullptr), m_free_orders(0) {
+                m_orders = log2(size) - min_block_log2 + 1;
+                std::size_t bits = 0;
+                std::size_t summary = 0;
+                for (std::size_t k = 0; k < m_orders; ++k) {
+                    const std::size_t words = words_for(size >> (min_block_log2 + k));
+                    m_bits_offset[k] = bits;
+                    m_summary_offset[k] = summary;
+                    bits += words;
+                    summary += words_for(words);
+                    m_free_count[k] = 0;
+                }
+                m_bits_offset[m_orders] = bits;
+                m_summary_offset[m_orders] = summary;
+                m_bits.assign(bits, 0);
+                m_summary.assign(summary, 0);
+                set(m_orders - 1, 0);
+            }
+
+            static inline std::size_t words_for(std::size_t bits) noexcept {
+                return (bits + 63) / 64;
+            }
+
+            inline bool test(std::size_t k, std::size_t i) const noexcept {
+                return (m_bits[m_bits_offset[k] + i / 64] >> (i % 64)) & 1;
+            }
+
+            inline void set(std::size_t k, std::size_t i) noexcept {
+                const std::size_t word = i / 64;
+                m_bits[m_bits_offset[k] + word] |= std::uint64_t(1) << (i % 64);
+                m_summary[m_summary_offset[k] + word / 64] |= std::uint64_t(1) << (word % 64);
+                if (m_free_count[k]++ == 0) {
+                    m_free_orders |= std::uint64_t(1) << k;
+                }
+            }
+
+            inline void clear(std::size_t k, std::size_t i) noexcept {
+                const std::size_t word = i / 64;
+                std::uint64_t &bits = m_bits[m_bits_offset[k] + word];
+                bits &= ~(std::uint64_t(1) << (i % 64));
+                if (bits == 0) {
+                    m_summary[m_summary_offset[k] + word / 64] &= ~(std::uint64_t(1) << (word % 64));
+                }
+                if (--m_free_count[k] == 0) {
+                    m_free_orders &= ~(std::uint64_t(1) << k);
+                }
+            }
+
+            // the lowest free block of order k, which has one
+            inline std::size_t first_free(std::size_t k) const noexcept {
+                const std::uint64_t *summary = m_summary.data() + m_summary_offset[k];
+                const std::uint64_t *bits = m_bits.data() + m_bits_offset[k];
+                for (std::size_t s = 0;; ++s) {
+                    if (summary[s] != 0) {
+                        const std::size_t word = s * 64 + static_cast<std::size_t>(__builtin_ctzll(summary[s]));
+                        return word * 64 + static_cast<std::size_t>(__builtin_ctzll(bits[word]));
+                    }
+                }
+            }
+
+            inline bool contains(pointer p) const noexcept {
+                return m_base <= p && p < m_base + m_size;
+            }
+
+            // a block of order k, splitting a larger one if need be, or nullptr
+            inline pointer allocate(std::size_t k) noexcept {
+                const std::uint64_t orders = m_free_orders & (~std::uint64_t(0) << k);
+                if (orders == 0) {
+                    return nullptr;
+                }
+                std::size_t j = static_cast<std::size_t>(__builtin_ctzll(orders));
+                std::size_t i = first_free(j);
+                clear(j, i);
+                while (j > k) {
+                    j--;
+                    i <<= 1;
+                    set(j, i + 1);
+                }
+                return m_base + (i << (min_block_log2 + k));
+            }
+
+            inline void deallocate(pointer p, std::size_t k) noexcept {
+                std::size_t i = static_cast<std::size_t>(p - m_base) >> (min_block_log2 + k);
+                assert(!test(k, i));
+                while (k + 1 < m_orders && test(k, i ^ 1)) {
+                    clear(k, i ^ 1);
+                    i >>= 1;
+                    k++;
+                }
+                set(k, i);
+            }
+
+            // whether nothing is allocated from the region
+            inline bool empty() const noexcept {
+                return test(m_orders - 1, 0);
+            }
+
+            // grow the block at 'p' from order 'from' to order 'to' in place, if it is
+            // the lower half at every step and each upper half is free, or shrink it
+            inline bool resize(pointer p, std::size_t from, std::size_t to) noexcept {
+                std::size_t i = static_cast<std::size_t>(p - m_base) >> (min_block_log2 + from);
+                if (to < from) {
+                    for (std::size_t k = from; k > to; --k) {
+                        set(k - 1, (i << (from - k + 1)) + 1);
+                    }
+                    return true;
+                }
+                if (to >= m_orders) {
+                    return false;
+                }
+                for (std::size_t k = from, j = i; k < to; ++k, j >>= 1) {
+                    if ((j & 1) != 0 || !test(k, j ^ 1)) {
+                        return false;
+                    }
+                }
+                for (std::size_t k = from, j = i; k < to; ++k, j >>= 1) {
+                    clear(k, j ^ 1);
+                }
+                return true;
+            }
+        };
+
+        std::size_t m_region_size;
+        commit_policy m_policy;
+        mutable Lock m_lock;
+
+        region *m_regions;
+        region *m_current;
+        std::size_t m_reserved;
+        std::size_t m_used;
+
+        static inline std::size_t log2(std::size_t n) noexcept {
+            return static_cast<std::size_t>(63 - __builtin_clzll(static_cast<unsigned long long>(n)));
+        }
+
+        // the order of the smallest block that holds 'size' bytes
+        static inline std::size_t order_for(std::size_t size) noexcept {
+            if (size <= min_block) {
+                return 0;
+            }
+            return log2(size - 1) + 1 - min_block_log2;
+        }
+
+        region *add_region(std::size_t size) {
+            bool mapped;
+            pointer base = static_cast<pointer>(slab_memory::allocate(size, min_block, m_policy, mapped));
+            region *r;
+            try {
+                r = new region(base, size, mapped);
+            } catch (...) {
+                slab_memory::deallocate(base, size, mapped);
+                throw;
+            }
+            r->m_next = m_regions;
+            m_regions = r;
+            m_reserved += size;
+            return r;
+        }
+
+        void remove_region(region *r) noexcept {
+            region **link = &m_regions;
+            while (*link != r) {
+                link = &(*link)->m_next;
+            }
+            *link = r->m_next;
+            if (m_current == r) {
+                m_current = m_regions;
+            }
+            m_reserved -= r->m_size;
+            slab_memory::deallocate(r->m_base, r->m_size, r->m_mapped);
+            delete r;
+        }
+
+        inline region *region_containing(pointer p) const noexcept {
+            if (likely(m_current->contains(p))) {
+                return m_current;
+            }
+            for (region *r = m_regions; r != nullptr; r = r->m_next) {
+                if (r->contains(p)) {
+                    return r;
+                }
+            }
+            return nullptr;
+        }
+
+        pointer take(std::size_t size) {
+            const std::size_t k = order_for(size);
+            pointer p = m_current->allocate(k);
+            if (unlikely(p == nullptr)) {
+                for (region *r = m_regions; r != nullptr && p == nullptr; r = r->m_next) {
+                    if ((p = r->allocate(k)) != nullptr) {
+                        m_current = r;
+                    }
+                }
+                if (p == nullptr) {
+                    region *r = add_region(std::max(m_region_size, min_block << k));
+                    p = r->allocate(k);
+                    if (r->m_size == m_region_size) {
+                        m_current = r;
+                    }
+                }
+            }
+            m_used += min_block << k;
+            return p;
+        }
+
+        void give_back(pointer p, std::size_t size) noexcept {
+            region *r = region_containing(p);
+            assert(r != nullptr);
+            if (r != nullptr) {
+                const std::size_t k = order_for(size);
+                r->deallocate(p, k);
+                m_used -= min_block << k;
+                if (r->m_size > m_region_size && r->empty()) {
+                    remove_region(r);
+                }
+            }
+        }
+
+    public:
+        ~buddy_arena() {
+            while (m_regions != nullptr) {
+                region *next = m_regions->m_next;
+                slab_memory::deallocate(m_regions->m_base, m_regions->m_size, m_regions->m_mapped);
+                delete m_regions;
+                m_regions = next;
+            }
+        }
+
+        buddy_arena(std::size_t region_size = 1024 * 1024, const commit_policy &policy = commit_policy()) : m_region_size(round_up_pow2(std::max(region_size, min_block))), m_policy(policy), m_regions(nullptr), m_reserved(0), m_used(0) {
+            m_current = add_region(m_region_size);
+        }
+
+        buddy_arena(const buddy_arena&) = delete;
+        buddy_arena& operator=(const buddy_arena&) = delete;
+
+        buddy_arena::pointer allocate(std::size_t size) {
+            pointer p;
+            {
+                std::lock_guard<Lock> guard(m_lock);
+                p = take(size);
+            }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        void deallocate(buddy_arena::pointer p, std::size_t size) noexcept {
+            allocation_profiler::deallocated(p);
+            std::lock_guard<Lock> guard(m_lock);
+            give_back(p, size);
+        }
+
+        template <typename P> void allocate_n(std::size_t size, std::size_t count, P *out) {
+            {
+                std::lock_guard<Lock> guard(m_lock);
+                for (std::size_t i = 0; i < count; ++i) {
+                    out[i] = reinterpret_cast<P>(take(size));
+                }
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::allocated(this, out[i], size);
+            }
+        }
+
+        template <typename P> void deallocate_n(const P *ptrs, std::size_t size, std::size_t count) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::deallocated(ptrs[i]);
+            }
+            std::lock_guard<Lock> guard(m_lock);
+            for (std::size_t i = 0; i < count; ++i) {
+                give_back(reinterpret_cast<pointer>(ptrs[i]), size);
+            }
+        }
+
+        // within the block's order, or by taking free buddies above it, without moving
+        bool try_expand(buddy_arena::pointer p, std::size_t old_size, std::size_t new_size) noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            const std::size_t from = order_for(old_size);
+            const std::size_t to = order_for(new_size);
+            if (from == to) {
+                return true;
+            }
+            region *r = region_containing(p);
+            assert(r != nullptr);
+            if (r != nullptr && r->resize(p, from, to)) {
+                m_used = m_used - (min_block << from) + (min_block << to);
+                return true;
+            }
+            return false;
+        }
+
+        buddy_arena::pointer reallocate(buddy_arena::pointer p, std::size_t old_size, std::size_t new_size) {
+            if (try_expand(p, old_size, new_size)) {
+                return p;
+            }
+            pointer n = allocate(new_size);
+            std::memcpy(n, p, std::min(old_size, new_size));
+            deallocate(p, old_size);
+            return n;
+        }
+
+        // bytes held in regions, and in blocks handed out (after rounding up to their order)
+        std::size_t reserved_bytes() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            return m_reserved;
+        }
+
+        std::size_t used_bytes() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            return m_used;
+        }
+
+        std::size_t region_count() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            std::size_t count = 0;
+            for (const region *r = m_regions; r != nullptr; r = r->m_next) {
+                count++;
+            }
+            return count;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const buddy_arena &a) {
+            std::lock_guard<Lock> guard(a.m_lock);
+            std::size_t regions = 0;
+            std::size_t free_blocks = 0;
+            for (const region *r = a.m_regions; r != nullptr; r = r->m_next) {
+                regions++;
+                for (std::size_t k = 0; k < r->m_orders; ++k) {
+                    free_blocks += r->m_free_count[k];
+                }
+            }
+            out << "allocated: " << a.m_used << " capacity: " << a.m_reserved << " free blocks: " << free_blocks << " from " << regions << " regions";
+            return out;
+        }
+    };
+
+    template <typename L> constexpr std::size_t buddy_arena<L>::min_block_log2;
+    template <typename L> constexpr std::size_t buddy_arena<L>::min_block;
+}
+
+#endif //FASTPATH_BUDDY_ARENA_H
@@ -0,0 +1,127 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+// Checks for small_vector, expandable_vector and arena_string appending from themselves:
+// growing moves the elements and releases the old buffer, so a source inside it must be
+// copied first. The allocator scribbles over every block it frees, so a copy from released memory
+// shows up as wrong contents without needing a sanitizer. A failure aborts with a
+// description; ctest runs it as container_tests.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "arena_string.h"
+#include "expandable_vector.h"
+#include "small_vector.h"
+
+namespace {
+
+    template <typename T> struct scribbling_allocator {
+        using value_type = T;
+
+        scribbling_allocator() noexcept {}
+        template <typename U> scribbling_allocator(const scribbling_allocator<U> &) noexcept {}
+
+        T *allocate(std::size_t size) {
+            return std::allocator<T>().allocate(size);
+        }
+
+        void deallocate(T *p, std::size_t size) noexcept {
+            std::memset(static_cast<void *>(p), 0xdd, size * sizeof(T));
+            std::allocator<T>().deallocate(p, size);
+        }
+    };
+
+    template <typename T, typename U> bool operator==(const scribbling_allocator<T> &, const scribbling_allocator<U> &) noexcept { return true; }
+    template <typename T, typename U> bool operator!=(const scribbling_allocator<T> &, const scribbling_allocator<U> &) noexcept { return false; }
+
+    using string_type = tf::basic_arena_string<scribbling_allocator<char>, 8>;
+
+    void check(bool condition, const char *what) {
+        if (!condition) {
+            std::cerr << "container_tests: " << what << std::endl;
+            std::abort();
+        }
+    }
+
+    void testStringAppendSelf() {
+        string_type s("spilled past inline", scribbling_allocator<char>());
+        check(!s.is_inline(), "string did not spill");
+        s += s;
+        check(s == string_type("spilled past inlinespilled past inline", scribbling_allocator<char>()), "s += s after a spill");
+
+        string_type t("0123456789", scribbling_allocator<char>());
+        t.append(t.data(), t.size());
+        t.append(t.data() + 5, 5);
+        check(t == string_type("0123456789012345678956789", scribbling_allocator<char>()), "append from inside the string");
+    }
+
+    template <typename T> void testVectorPushBackSelf(const T &first, const T &second) {
+        tf::small_vector<T, 2, scribbling_allocator<T>> v((scribbling_allocator<T>()));
+        v.push_back(first);
+        v.push_back(second);
+        // inline to spilled, then spilled to a bigger block
+        for (int i = 0; i < 6; ++i) {
+            v.push_back(v[0]);
+        }
+        check(v.size() == 8, "push_back size");
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            check(v[i] == (i == 1 ? second : first), "push_back(v[0]) while growing");
+        }
+
+        v.append(v.begin(), v.end());
+        check(v.size() == 16, "append size");
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            check(v[i] == (i % 8 == 1 ? second : first), "append(v.begin(), v.end()) while growing");
+        }
+    }
+
+    template <typename T> void testExpandablePushBackSelf(const T &first, const T &second) {
+        tf::expandable_vector<T, scribbling_allocator<T>> v;
+        v.push_back(first);
+        v.push_back(second);
+        // past the first buffer of 8 and the next of 16
+        for (int i = 0; i < 30; ++i) {
+            v.push_back(v[0]);
+        }
+        check(v.size() == 32, "expandable_vector push_back size");
+        for (std::size_t i = 0; i < v.size(); ++i) {
+            check(v[i] == (i == 1 ? second : first), "expandable_vector push_back(v[0]) while growing");
+        }
+    }
+}
+
+int main() {
+    testStringAppendSelf();
+    testVectorPushBackSelf<int>(1, 2);
+    testVectorPushBackSelf<std::string>(std::string(40, 'a'), std::string(40, 'b'));
+    testExpandablePushBackSelf<int>(1, 2);
+    testExpandablePushBackSelf<std::string>(std::string(40, 'a'), std::string(40, 'b'));
+    std::cout << "container tests passed" << std::endl;
+    return 0;
+}
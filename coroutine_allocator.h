@@ -0,0 +1,197 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_COROUTINE_ALLOCATOR_H
+#define FASTPATH_COROUTINE_ALLOCATOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+#include "optimize.h"
+
+namespace tf {
+
+    // A per-thread store for coroutine frames.
+    //
+    // Frames are bump allocated from one large reservation of address space, which
+    // the kernel only backs with memory as it is touched. A frame of a given size
+    // is almost always followed by another of the same size, so released frames go
+    // onto a free list per 16 byte size class and are reused directly.
+    //
+    // A frame_group marks the current top of the reservation. Until the group ends,
+    // frames come only from above the mark and releasing them does nothing; ending
+    // the group rewinds to the mark, releasing every frame of the task group at once.
+    //
+    // Frames must be released on the thread that allocated them. Anything that does
+    // not fit, either in size or in the reservation, comes from ::operator new.
+    class frame_arena {
+    public:
+        using value_type = unsigned char;
+        using pointer = value_type*;
+
+        static constexpr std::size_t alignment = 16;
+        static constexpr std::size_t max_pooled_size = 4096;
+        static constexpr std::size_t reservation_size = std::size_t(256) * 1024 * 1024;
+
+    private:
+        struct free_frame {
+            free_frame *m_next;
+        };
+
+        static constexpr std::size_t size_classes = max_pooled_size / alignment;
+
+        pointer m_base;
+        pointer m_head;
+        pointer m_end;
+
+        // the mark of the outermost active group, frames above it are released by rewinding
+        pointer m_group_base;
+
+        free_frame *m_free[size_classes];
+
+        static inline std::size_t align_up(std::size_t n) noexcept {
+            return (n + (alignment - 1)) & ~(alignment - 1);
+        }
+
+        inline bool owns(const void *p) const noexcept {
+            return m_base <= p && p < m_end;
+        }
+
+        friend class frame_group;
+
+    public:
+        frame_arena() noexcept : m_base(nullptr), m_head(nullptr), m_end(nullptr), m_group_base(nullptr), m_free() {
+            void *p = ::mmap(nullptr, reservation_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if (p != MAP_FAILED) {
+                m_base = static_cast<pointer>(p);
+                m_head = m_base;
+                m_end = m_base + reservation_size;
+            }
+        }
+
+        ~frame_arena() {
+            if (m_base != nullptr) {
+                ::munmap(m_base, reservation_size);
+            }
+        }
+
+        frame_arena(const frame_arena &) = delete;
+        frame_arena &operator=(const frame_arena &) = delete;
+
+        // the calling thread's frame store
+        static frame_arena &local() noexcept {
+            static thread_local frame_arena s_arena;
+            return s_arena;
+        }
+
+        void *allocate(std::size_t size) {
+            size = align_up(size);
+            if (likely(size <= max_pooled_size)) {
+                free_frame *&list = m_free[size / alignment - 1];
+                if (list != nullptr && m_group_base == nullptr) {
+                    free_frame *f = list;
+                    list = f->m_next;
+                    return f;
+                }
+                if (likely(static_cast<std::size_t>(m_end - m_head) >= size)) {
+                    pointer p = m_head;
+                    m_head += size;
+                    return p;
+                }
+            }
+            return ::operator new(size);
+        }
+
+        void deallocate(void *p, std::size_t size) noexcept {
+            if (unlikely(!owns(p))) {
+                ::operator delete(p);
+                return;
+            }
+            if (m_group_base != nullptr && p >= m_group_base) {
+                // released in bulk when the group ends
+                return;
+            }
+            size = align_up(size);
+            if (m_group_base == nullptr && static_cast<pointer>(p) + size == m_head) {
+                m_head = static_cast<pointer>(p);
+            } else {
+                free_frame *f = static_cast<free_frame *>(p);
+                free_frame *&list = m_free[size / alignment - 1];
+                f->m_next = list;
+                list = f;
+            }
+        }
+
+        // bytes of the reservation currently bump allocated, including pooled frames
+        std::size_t used() const noexcept {
+            return static_cast<std::size_t>(m_head - m_base);
+        }
+    };
+
+    // Scopes a task group on the calling thread: every frame allocated while it is
+    // alive is released together when it is destroyed, so the coroutines started in
+    // it must all have completed (or been destroyed) by then. Groups may nest.
+    class frame_group {
+        frame_arena &m_arena;
+        frame_arena::pointer m_mark;
+        bool m_outermost;
+
+    public:
+        frame_group() noexcept : frame_group(frame_arena::local()) {}
+
+        explicit frame_group(frame_arena &arena) noexcept : m_arena(arena), m_mark(arena.m_head), m_outermost(arena.m_group_base == nullptr) {
+            if (m_outermost) {
+                m_arena.m_group_base = m_mark;
+            }
+        }
+
+        ~frame_group() {
+            assert(m_arena.m_head >= m_mark);
+            m_arena.m_head = m_mark;
+            if (m_outermost) {
+                m_arena.m_group_base = nullptr;
+            }
+        }
+
+        frame_group(const frame_group &) = delete;
+        frame_group &operator=(const frame_group &) = delete;
+    };
+
+    // Derive a coroutine's promise_type from this to take its frames from the
+    // thread's frame_arena rather than the global operator new.
+    struct arena_frame_allocator {
+        static void *operator new(std::size_t size) {
+            return frame_arena::local().allocate(size);
+        }
+
+        static void operator delete(void *p, std::size_t size) noexcept {
+            frame_arena::local().deallocate(p, size);
+        }
+    };
+}
+
+#endif //FASTPATH_COROUTINE_ALLOCATOR_H
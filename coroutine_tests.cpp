@@ -0,0 +1,203 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+// Spawning and completing short coroutines, with frames from the global operator
+// new against tf::arena_frame_allocator. Built only when the compiler has C++20
+// coroutines, the rest of the benchmarks stay C++14.
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "coroutine_allocator.h"
+#include "performance.h"
+
+static const std::size_t iterations = 5000000;
+static const std::size_t batch_size = 1024;
+
+// keeps the results from being optimised away
+static volatile std::uint64_t result_sink;
+
+struct default_frames {};
+
+// A lazily started task, resumed by whoever awaits or runs it
+template <typename FrameAllocator> class task {
+public:
+    struct promise_type : FrameAllocator {
+        std::uint64_t m_value = 0;
+        std::coroutine_handle<> m_continuation;
+
+        task get_return_object() noexcept { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        struct final_awaiter {
+            bool await_ready() noexcept { return false; }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> continuation = h.promise().m_continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        final_awaiter final_suspend() noexcept { return {}; }
+
+        void return_value(std::uint64_t value) noexcept { m_value = value; }
+
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
+
+    explicit task(std::coroutine_handle<promise_type> handle) noexcept : m_handle(handle) {}
+
+public:
+    task(task &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    task(const task &) = delete;
+    task &operator=(const task &) = delete;
+
+    ~task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+        m_handle.promise().m_continuation = continuation;
+        return m_handle;
+    }
+
+    std::uint64_t await_resume() const noexcept { return m_handle.promise().m_value; }
+
+    // run a top level task to completion
+    std::uint64_t run() {
+        m_handle.resume();
+        return m_handle.promise().m_value;
+    }
+};
+
+template <typename F> task<F> leaf(std::uint64_t i) {
+    co_return i * 2;
+}
+
+template <typename F> task<F> parent(std::uint64_t i) {
+    const std::uint64_t a = co_await leaf<F>(i);
+    const std::uint64_t b = co_await leaf<F>(i + 1);
+    co_return a + b;
+}
+
+// No grouping, or a tf::frame_group around every batch of batch_size coroutines
+struct ungrouped {
+    ungrouped() noexcept {}
+};
+
+using grouped = tf::frame_group;
+
+template <typename F, typename Group> void testSpawnComplete() {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < iterations; i += batch_size) {
+        Group group;
+        for (std::size_t j = i; j < i + batch_size; ++j) {
+            sum += leaf<F>(j).run();
+        }
+    }
+    result_sink = sum;
+}
+
+template <typename F, typename Group> void testNested() {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < iterations / 3; i += batch_size) {
+        Group group;
+        for (std::size_t j = i; j < i + batch_size; ++j) {
+            sum += parent<F>(j).run();
+        }
+    }
+    result_sink = sum;
+}
+
+// a batch of suspended coroutines all alive at once, as when fanning out I/O
+template <typename F, typename Group> void testBatched() {
+    std::vector<task<F>> tasks;
+    tasks.reserve(batch_size);
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < iterations; i += batch_size) {
+        Group group;
+        for (std::size_t j = i; j < i + batch_size; ++j) {
+            tasks.push_back(leaf<F>(j));
+        }
+        for (task<F> &t : tasks) {
+            sum += t.run();
+        }
+        tasks.clear();
+    }
+    result_sink = sum;
+}
+
+static void logTime(const std::chrono::microseconds &time) {
+    auto t = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time);
+    std::cout << std::setw(27) << std::setprecision(4) << std::fixed << std::right << t.count() << " ms";
+}
+
+static void printHeader(const std::vector<std::string> &tests) {
+    std::cout << std::left << std::setw(60) << "Allocator Type";
+    for (const std::string &test : tests) {
+        std::cout << std::setw(30) << std::setprecision(3) << std::right << test;
+    }
+    std::cout << std::endl;
+}
+
+template <typename F, typename Group> void runCoroutineTests(const char *name) {
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testSpawnComplete<F, Group>(); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testNested<F, Group>(); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testBatched<F, Group>(); }));
+    std::cout << std::endl;
+}
+
+int main() {
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing coroutine frames" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"SpawnComplete", "Nested", "Batched"});
+
+    runCoroutineTests<default_frames, ungrouped>("operator new");
+    runCoroutineTests<tf::arena_frame_allocator, ungrouped>("tf::arena_frame_allocator");
+    runCoroutineTests<tf::arena_frame_allocator, grouped>("tf::arena_frame_allocator + tf::frame_group");
+
+    return 0;
+}
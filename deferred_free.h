@@ -0,0 +1,136 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_DEFERRED_FREE_H
+#define FASTPATH_DEFERRED_FREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include "fast_linear_allocator.h"
+#include "optimize.h"
+
+namespace tf {
+
+    // A front end for an arena that queues frees in a small buffer and hands them over
+    // in batches, through the arena's deallocate_batch. A batch is sorted by address, so
+    // each slab is looked up and its count updated once per batch rather than once per
+    // free, and a locked arena's lock is taken once per batch.
+    //
+    // The buffer is not synchronised: each thread should have its own deferred_free in
+    // front of a shared arena. Queued blocks are not available for reuse until the
+    // batch is flushed, which happens when the buffer fills, when flush() is called
+    // (on demand, or from the owning thread's idle hook), and on destruction.
+    //
+    // Allocation is forwarded unchanged, so deferred_free can stand in for the arena
+    // anywhere, e.g. linear_allocator<T, deferred_free<tf::arena>>.
+    template <typename Arena = tf::arena, std::size_t Capacity = 64> class deferred_free {
+    public:
+        using arena_type = Arena;
+        using pointer = typename Arena::pointer;
+        using block = std::pair<pointer, std::size_t>;
+
+        static_assert(is_arena<Arena>::value, "deferred_free needs an Arena, see arena_traits.h");
+        static_assert(Capacity > 0, "the buffer needs room for at least one free");
+
+    private:
+        Arena &m_arena;
+        std::size_t m_count;
+        block m_pending[Capacity];
+
+    public:
+        explicit deferred_free(Arena &arena) noexcept : m_arena(arena), m_count(0) {}
+
+        ~deferred_free() {
+            flush();
+        }
+
+        deferred_free(const deferred_free &) = delete;
+        deferred_free &operator=(const deferred_free &) = delete;
+
+        inline pointer allocate(std::size_t size) {
+            return m_arena.allocate(size);
+        }
+
+        inline pointer allocate_zeroed(std::size_t size) {
+            return m_arena.allocate_zeroed(size);
+        }
+
+        inline pointer allocate_uninit(std::size_t size) {
+            return m_arena.allocate_uninit(size);
+        }
+
+        template <typename P> inline void allocate_n(std::size_t size, std::size_t count, P *out) {
+            m_arena.allocate_n(size, count, out);
+        }
+
+        inline void deallocate(pointer p, std::size_t size) noexcept {
+            m_pending[m_count++] = block(p, size);
+            if (unlikely(m_count == Capacity)) {
+                flush();
+            }
+        }
+
+        template <typename P> inline void deallocate_n(const P *ptrs, std::size_t size, std::size_t count) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                deallocate(reinterpret_cast<pointer>(ptrs[i]), size);
+            }
+        }
+
+        inline bool try_expand(pointer p, std::size_t old_size, std::size_t new_size) noexcept {
+            return m_arena.try_expand(p, old_size, new_size);
+        }
+
+        // as the arena's reallocate, except that the old block's free is queued
+        pointer reallocate(pointer p, std::size_t old_size, std::size_t new_size) {
+            if (try_expand(p, old_size, new_size)) {
+                return p;
+            }
+            pointer n = allocate(new_size);
+            std::memcpy(n, p, std::min(old_size, new_size));
+            deallocate(p, old_size);
+            return n;
+        }
+
+        // hand every queued free to the arena, nothing to do if none are queued
+        inline void flush() noexcept {
+            if (m_count != 0) {
+                m_arena.deallocate_batch(m_pending, m_count);
+                m_count = 0;
+            }
+        }
+
+        std::size_t pending() const noexcept {
+            return m_count;
+        }
+
+        Arena &arena() const noexcept {
+            return m_arena;
+        }
+    };
+}
+
+#endif //FASTPATH_DEFERRED_FREE_H
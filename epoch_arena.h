@@ -0,0 +1,366 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_EPOCH_ARENA_H
+#define FASTPATH_EPOCH_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include "allocation_profiler.h"
+#include "optimize.h"
+#include "slab_memory.h"
+#include "zero_fill.h"
+
+namespace tf {
+
+    // An arena for objects that die in generations (per tick, per batch, ...).
+    //
+    // Allocations are carved from slabs owned by the current epoch, and
+    // advance_epoch() starts a new epoch with its own slabs. Once every block from
+    // an older epoch has been released, all of its slabs are reclaimed in one go,
+    // so a single long-lived object can only pin its own epoch rather than an
+    // arbitrary slab. Epochs still alive well after they were retired are reported
+    // by report_survivors() to help track down lifetime leaks.
+    class epoch_arena {
+    public:
+        using value_type = unsigned char;
+        using pointer = value_type*;
+        using epoch_id = std::uint64_t;
+
+    private:
+        struct alignas(16) slab {
+            pointer m_content;
+            pointer m_head;
+            slab *m_next;
+            std::size_t m_size;
+            std::size_t m_allocated;
+            // everything from here (or from m_head, if that is higher) up is still zero:
+            // the whole of a slab fresh from mmap, none of one from malloc
+            pointer m_clean;
+            bool m_mapped;
+
+            static inline std::size_t align_up(std::size_t n) noexcept {
+                static const size_t alignment = 16;
+                return (n + (alignment-1)) & ~(alignment-1);
+            }
+
+            inline bool pointer_in_buffer(pointer p) const noexcept {
+                return m_content <= p && p < m_content + m_size;
+            }
+
+            // large slabs are mapped, so they start out zero; they are never trimmed
+            slab(std::size_t size) : m_next(nullptr), m_size(size), m_allocated(0) {
+                m_content = static_cast<pointer>(slab_memory::allocate(size, 16, commit_policy(), m_mapped));
+                m_head = m_content;
+                m_clean = m_mapped ? m_content : m_content + m_size;
+            }
+
+            ~slab() noexcept {
+                slab_memory::deallocate(m_content, m_size, m_mapped);
+            }
+
+            inline void lower_head(pointer head) noexcept {
+                if (m_head > m_clean) {
+                    m_clean = m_head;
+                }
+                m_head = head;
+            }
+
+            inline std::size_t free() const noexcept {
+                return m_size - std::distance(m_content, m_head);
+            }
+
+            inline pointer allocate(std::size_t size) noexcept {
+                assert(this->free() >= size);
+                pointer p = m_head;
+                std::advance(m_head, size);
+                m_allocated += size;
+                return p;
+            }
+
+            // as allocate, also counting how many of the block's first 'size' bytes may not be zero
+            inline pointer allocate_clean(std::size_t size, std::size_t used, std::size_t &dirty) noexcept {
+                pointer p = allocate(used);
+                dirty = m_clean > p ? std::min(static_cast<std::size_t>(m_clean - p), size) : 0;
+                return p;
+            }
+
+            inline void deallocate(pointer ptr, std::size_t size) noexcept {
+                assert(pointer_in_buffer(ptr));
+                if ((m_allocated -= size) == 0) {
+                    lower_head(m_content);
+                } else if (ptr + size == m_head) {
+                    lower_head(ptr);
+                }
+            }
+        };
+
+        struct epoch {
+            epoch_id m_id;
+            slab *m_root_slab;
+            slab *m_current_slab;
+            std::size_t m_allocated;
+            std::size_t m_blocks;
+            epoch *m_older;
+
+            epoch(epoch_id id, epoch *older) noexcept : m_id(id), m_root_slab(nullptr), m_current_slab(nullptr), m_allocated(0), m_blocks(0), m_older(older) {}
+
+            inline slab *find_slab_with_space(std::size_t size) const noexcept {
+                for (slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                    if (s->free() >= size) {
+                        return s;
+                    }
+                }
+                return nullptr;
+            }
+
+            inline slab *find_slab_containing(pointer ptr) const noexcept {
+                for (slab *s = m_root_slab; s != nullptr; s = s->m_next) {
+                    if (s->pointer_in_buffer(ptr)) {
+                        return s;
+                    }
+                }
+                return nullptr;
+            }
+        };
+
+        std::size_t m_initial_size;
+        std::size_t m_max_spare_slabs;
+
+        epoch *m_current;
+        slab *m_spare_slabs;
+        std::size_t m_spare_count;
+        std::size_t m_reclaimed_epochs;
+
+        slab *take_slab(std::size_t size) {
+            slab **prev = &m_spare_slabs;
+            for (slab *s = m_spare_slabs; s != nullptr; prev = &s->m_next, s = s->m_next) {
+                if (s->m_size >= size) {
+                    *prev = s->m_next;
+                    s->m_next = nullptr;
+                    m_spare_count--;
+                    return s;
+                }
+            }
+            return new slab(std::max(size, m_initial_size));
+        }
+
+        void give_slab(slab *s) noexcept {
+            if (m_spare_count < m_max_spare_slabs) {
+                s->lower_head(s->m_content);
+                s->m_allocated = 0;
+                s->m_next = m_spare_slabs;
+                m_spare_slabs = s;
+                m_spare_count++;
+            } else {
+                delete s;
+            }
+        }
+
+        // hand all of an epoch's slabs back in one go
+        void reclaim(epoch *e) noexcept {
+            slab *s = e->m_root_slab;
+            while (s != nullptr) {
+                slab *next = s->m_next;
+                give_slab(s);
+                s = next;
+            }
+            delete e;
+            m_reclaimed_epochs++;
+        }
+
+        // the slab in the current epoch that the next 'size' byte block is carved from,
+        // with the block already counted against the epoch
+        slab *slab_with_space(std::size_t size) {
+            // zero sized blocks still take space, so every block can be found again by address
+            size = slab::align_up(std::max<std::size_t>(size, 1));
+            epoch *e = m_current;
+            e->m_allocated += size;
+            e->m_blocks++;
+            if (likely(e->m_current_slab != nullptr && e->m_current_slab->free() >= size)) {
+                return e->m_current_slab;
+            }
+
+            slab *s = e->find_slab_with_space(size);
+            if (s == nullptr) {
+                s = take_slab(size);
+                s->m_next = e->m_root_slab;
+                e->m_root_slab = s;
+            }
+            e->m_current_slab = s;
+            return s;
+        }
+
+    public:
+        ~epoch_arena() {
+            epoch *e = m_current;
+            while (e != nullptr) {
+                epoch *older = e->m_older;
+                slab *s = e->m_root_slab;
+                while (s != nullptr) {
+                    slab *next = s->m_next;
+                    delete s;
+                    s = next;
+                }
+                delete e;
+                e = older;
+            }
+            slab *s = m_spare_slabs;
+            while (s != nullptr) {
+                slab *next = s->m_next;
+                delete s;
+                s = next;
+            }
+        }
+
+        epoch_arena(std::size_t initial_size = 1024, std::size_t max_spare_slabs = 16) noexcept : m_initial_size(initial_size), m_max_spare_slabs(max_spare_slabs), m_current(new epoch(0, nullptr)), m_spare_slabs(nullptr), m_spare_count(0), m_reclaimed_epochs(0) {
+        }
+
+        epoch_arena(const epoch_arena&) = delete;
+        epoch_arena& operator=(const epoch_arena&) = delete;
+
+        epoch_arena::pointer allocate(std::size_t size) {
+            pointer p = slab_with_space(size)->allocate(slab::align_up(std::max<std::size_t>(size, 1)));
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // a block of 'size' bytes, all zero, which only needs clearing as far as the slab has been used before
+        epoch_arena::pointer allocate_zeroed(std::size_t size) {
+            std::size_t dirty;
+            pointer p = slab_with_space(size)->allocate_clean(size, slab::align_up(std::max<std::size_t>(size, 1)), dirty);
+            if (dirty != 0) {
+                zero_fill(p, dirty);
+            }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // the same as allocate, the arenas never initialise what they hand out; for
+        // call sites to say that they will overwrite the whole block themselves
+        epoch_arena::pointer allocate_uninit(std::size_t size) {
+            return allocate(size);
+        }
+
+        void deallocate(epoch_arena::pointer p, std::size_t size) noexcept {
+            allocation_profiler::deallocated(p);
+            size = slab::align_up(std::max<std::size_t>(size, 1));
+            epoch *e = m_current;
+            if (likely(e->m_current_slab != nullptr && e->m_current_slab->pointer_in_buffer(p))) {
+                e->m_current_slab->deallocate(p, size);
+                e->m_allocated -= size;
+                e->m_blocks--;
+                return;
+            }
+
+            epoch *newer = nullptr;
+            for (; e != nullptr; newer = e, e = e->m_older) {
+                slab *s = e->find_slab_containing(p);
+                if (s != nullptr) {
+                    s->deallocate(p, size);
+                    e->m_allocated -= size;
+                    if (--e->m_blocks == 0 && newer != nullptr) {
+                        newer->m_older = e->m_older;
+                        reclaim(e);
+                    }
+                    return;
+                }
+            }
+            assert(false && "pointer not allocated from this epoch_arena");
+        }
+
+        // retire the current epoch and start allocating from fresh slabs
+        epoch_id advance_epoch() {
+            epoch *retired = m_current;
+            m_current = new epoch(retired->m_id + 1, retired);
+            if (retired->m_blocks == 0) {
+                m_current->m_older = retired->m_older;
+                reclaim(retired);
+            }
+            return m_current->m_id;
+        }
+
+        epoch_id current_epoch() const noexcept {
+            return m_current->m_id;
+        }
+
+        // number of retired epochs still holding live blocks
+        std::size_t surviving_epochs() const noexcept {
+            std::size_t count = 0;
+            for (const epoch *e = m_current->m_older; e != nullptr; e = e->m_older) {
+                count++;
+            }
+            return count;
+        }
+
+        // bytes in blocks handed out from every epoch, after rounding up to the arena's alignment
+        std::size_t used_bytes() const noexcept {
+            std::size_t bytes = 0;
+            for (const epoch *e = m_current; e != nullptr; e = e->m_older) {
+                bytes += e->m_allocated;
+            }
+            return bytes;
+        }
+
+        // list every retired epoch at least 'min_age' epochs old that still has live blocks
+        void report_survivors(std::ostream &out, std::size_t min_age = 1) const {
+            for (const epoch *e = m_current->m_older; e != nullptr; e = e->m_older) {
+                const std::size_t age = m_current->m_id - e->m_id;
+                if (age >= min_age) {
+                    std::size_t slabs = 0;
+                    for (const slab *s = e->m_root_slab; s != nullptr; s = s->m_next) {
+                        slabs++;
+                    }
+                    out << "epoch " << e->m_id << " (age " << age << "): " << e->m_blocks << " blocks, " << e->m_allocated << " bytes outstanding in " << slabs << " slabs" << std::endl;
+                }
+            }
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const epoch_arena &a) {
+            std::size_t block_count = 0;
+            std::size_t total_capacity = 0;
+            std::size_t total_allocated = 0;
+            std::size_t epoch_count = 0;
+
+            for (const epoch *e = a.m_current; e != nullptr; e = e->m_older) {
+                epoch_count++;
+                total_allocated += e->m_allocated;
+                for (const slab *s = e->m_root_slab; s != nullptr; s = s->m_next) {
+                    block_count++;
+                    total_capacity += s->m_size;
+                }
+            }
+
+            out << "allocated: " << total_allocated << " capacity: " << total_capacity << " from " << block_count << " blocks in " << epoch_count << " epochs (" << a.m_reclaimed_epochs << " reclaimed, " << a.m_spare_count << " spare slabs)";
+            return out;
+        }
+    };
+}
+
+#endif //FASTPATH_EPOCH_ARENA_H
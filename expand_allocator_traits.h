@@ -0,0 +1,74 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_EXPAND_ALLOCATOR_TRAITS_H
+#define FASTPATH_EXPAND_ALLOCATOR_TRAITS_H
+
+#include <cstddef>
+#include <memory>
+
+namespace tf {
+
+    // Uses an allocator's expand() to resize an allocation in place if it provides
+    // one, otherwise reports that the allocation cannot be resized. Likewise
+    // allocate_at_least() reports any slack the allocator rounded the block up to.
+    template <typename A> struct expand_allocator_traits {
+        using pointer = typename std::allocator_traits<A>::pointer;
+        using size_type = typename std::allocator_traits<A>::size_type;
+
+        struct allocation_result {
+            pointer ptr;
+            size_type count;
+        };
+
+        static bool expand(A &allocator, pointer p, size_type old_size, size_type new_size) {
+            return expand(allocator, p, old_size, new_size, 0);
+        }
+
+        static allocation_result allocate_at_least(A &allocator, size_type size) {
+            return allocate_at_least(allocator, size, 0);
+        }
+
+    private:
+        template <typename B> static auto expand(B &allocator, pointer p, size_type old_size, size_type new_size, int) -> decltype(allocator.expand(p, old_size, new_size)) {
+            return allocator.expand(p, old_size, new_size);
+        }
+
+        template <typename B> static bool expand(B &, pointer, size_type, size_type, long) {
+            return false;
+        }
+
+        template <typename B> static auto allocate_at_least(B &allocator, size_type size, int) -> decltype(allocator.allocate_at_least(size), allocation_result()) {
+            auto r = allocator.allocate_at_least(size);
+            return {r.ptr, r.count};
+        }
+
+        template <typename B> static allocation_result allocate_at_least(B &allocator, size_type size, long) {
+            return {std::allocator_traits<B>::allocate(allocator, size), size};
+        }
+    };
+}
+
+#endif //FASTPATH_EXPAND_ALLOCATOR_TRAITS_H
@@ -0,0 +1,156 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_EXPANDABLE_VECTOR_H
+#define FASTPATH_EXPANDABLE_VECTOR_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include "expand_allocator_traits.h"
+#include "optimize.h"
+
+namespace tf {
+
+    // A minimal vector that grows its buffer in place when the allocator supports
+    // expand() (e.g. tf::linear_allocator while the buffer is the last block in its
+    // slab), and only falls back to allocate + move when that fails.
+    template <typename T, typename Allocator = std::allocator<T>> class expandable_vector {
+    public:
+        using value_type = T;
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using pointer = typename std::allocator_traits<Allocator>::pointer;
+        using iterator = value_type *;
+        using const_iterator = const value_type *;
+
+    private:
+        using traits = std::allocator_traits<Allocator>;
+
+        allocator_type m_allocator;
+        pointer m_begin;
+        size_type m_size;
+        size_type m_capacity;
+
+        void grow(size_type capacity) {
+            grow(capacity, [](pointer) {});
+        }
+
+        // As above, with 'construct' building the new element just past the existing ones
+        // before they are moved out and the old buffer released, as std::vector does, so
+        // an argument referring to an element (v.push_back(v[0])) is still intact when read.
+        template <typename Construct> void grow(size_type capacity, Construct &&construct) {
+            if (m_begin != nullptr && expand_allocator_traits<Allocator>::expand(m_allocator, m_begin, m_capacity, capacity)) {
+                m_capacity = capacity;
+                construct(m_begin + m_size);
+                return;
+            }
+
+            auto block = expand_allocator_traits<Allocator>::allocate_at_least(m_allocator, capacity);
+            try {
+                construct(block.ptr + m_size);
+            } catch (...) {
+                traits::deallocate(m_allocator, block.ptr, block.count);
+                throw;
+            }
+            for (size_type i = 0; i < m_size; ++i) {
+                traits::construct(m_allocator, block.ptr + i, std::move_if_noexcept(m_begin[i]));
+                traits::destroy(m_allocator, m_begin + i);
+            }
+            if (m_begin != nullptr) {
+                traits::deallocate(m_allocator, m_begin, m_capacity);
+            }
+            m_begin = block.ptr;
+            m_capacity = block.count;
+        }
+
+    public:
+        explicit expandable_vector(const allocator_type &allocator = allocator_type()) : m_allocator(allocator), m_begin(nullptr), m_size(0), m_capacity(0) {}
+
+        ~expandable_vector() {
+            clear();
+            if (m_begin != nullptr) {
+                traits::deallocate(m_allocator, m_begin, m_capacity);
+            }
+        }
+
+        expandable_vector(const expandable_vector &) = delete;
+        expandable_vector &operator=(const expandable_vector &) = delete;
+
+        void reserve(size_type capacity) {
+            if (capacity > m_capacity) {
+                grow(capacity);
+            }
+        }
+
+        template <typename ...Args> reference emplace_back(Args &&... args) {
+            if (unlikely(m_size == m_capacity)) {
+                grow(m_capacity == 0 ? 8 : m_capacity * 2, [&](pointer to) { traits::construct(m_allocator, to, std::forward<Args>(args)...); });
+            } else {
+                traits::construct(m_allocator, m_begin + m_size, std::forward<Args>(args)...);
+            }
+            return m_begin[m_size++];
+        }
+
+        void push_back(const value_type &value) { emplace_back(value); }
+        void push_back(value_type &&value) { emplace_back(std::move(value)); }
+
+        void pop_back() {
+            traits::destroy(m_allocator, m_begin + --m_size);
+        }
+
+        void clear() {
+            while (m_size != 0) {
+                pop_back();
+            }
+        }
+
+        // give back unused capacity, in place where the allocator allows
+        void shrink_to_fit() {
+            if (m_size < m_capacity && m_begin != nullptr && expand_allocator_traits<Allocator>::expand(m_allocator, m_begin, m_capacity, m_size)) {
+                m_capacity = m_size;
+            }
+        }
+
+        size_type size() const noexcept { return m_size; }
+        size_type capacity() const noexcept { return m_capacity; }
+        bool empty() const noexcept { return m_size == 0; }
+
+        value_type *data() noexcept { return m_begin; }
+        const value_type *data() const noexcept { return m_begin; }
+
+        reference operator[](size_type i) noexcept { return m_begin[i]; }
+        const_reference operator[](size_type i) const noexcept { return m_begin[i]; }
+
+        iterator begin() noexcept { return m_begin; }
+        iterator end() noexcept { return m_begin + m_size; }
+        const_iterator begin() const noexcept { return m_begin; }
+        const_iterator end() const noexcept { return m_begin + m_size; }
+    };
+}
+
+#endif //FASTPATH_EXPANDABLE_VECTOR_H
@@ -27,161 +27,15 @@
 #define FASTPATH_FAST_LINEAR_ALLOCATOR_H
 
 #include <cstddef>
-#include <cassert>
-#include "optimize.h"
+#include "arena_traits.h"
+#include "basic_arena.h"
 
 namespace tf {
 
-    class arena {
-    public:
-        using value_type = unsigned char;
-        using pointer = value_type*;
-
-    private:
-        struct alignas(16) slab {
-            pointer m_content;
-            pointer m_head;
-            slab *m_next;
-            std::size_t m_size;
-            std::size_t m_allocated;
-
-            static inline std::size_t align_up(std::size_t n) noexcept {
-                static const size_t alignment = 16;
-                return (n + (alignment-1)) & ~(alignment-1);
-            }
-
-            inline bool pointer_in_buffer(pointer p) const noexcept {
-                return m_content <= p && p <= m_head;
-            }
-
-            slab(std::size_t size) noexcept : m_next(nullptr), m_size(size), m_allocated(0) {
-//                m_content = std::allocator_traits<allocator_type>::allocate(m_allocator, m_size);
-//                m_content = new value_type[size];
-                m_content = static_cast<pointer>(::malloc(size));
-                m_head = m_content;
-            }
-
-            ~slab() noexcept {
-//                std::allocator_traits<allocator_type>::deallocate(m_allocator, m_content, m_size);
-//                delete [] m_content;
-                ::free(m_content);
-            }
-
-            inline std::size_t free() const noexcept {
-                return m_size - std::distance(m_content, m_head);
-            }
-
-            inline pointer allocate(std::size_t size) noexcept {
-                size = align_up(size);
-                assert(this->free() >= size);
-                pointer p = m_head;
-                std::advance(m_head, size);
-                m_allocated += size;
-                return p;
-            }
-
-            inline void deallocate(pointer ptr, std::size_t size) noexcept {
-                assert(pointer_in_buffer(ptr));
-                size = align_up(size);
-                if ((m_allocated -= size) == 0) {
-                    m_head = m_content;
-                } else if (ptr + size == m_head) {
-                    m_head = ptr;
-                }
-            }
-        };
-
-        std::size_t m_initial_size;
-
-        slab *m_root_slab;
-        slab *m_current_slab;
-
-        inline slab *find_slab_with_space(slab *start, std::size_t size) const noexcept {
-            if (likely(start->free() >= size)) {
-                return start;
-            } else if (start->m_next != nullptr) {
-                return find_slab_with_space(start->m_next, size);
-            }
-
-            return nullptr;
-        }
-
-        inline slab *find_slab_containing(slab *start, pointer ptr) const noexcept {
-            if (likely(start->pointer_in_buffer(ptr))) {
-                return start;
-            } else if (start->m_next != nullptr) {
-                return find_slab_containing(start->m_next, ptr);
-            }
-
-            return nullptr;
-        }
-
-    public:
-        ~arena() {
-            slab *s = m_root_slab;
-            while (s != nullptr) {
-                s = s->m_next;
-                delete s;
-            }
-            m_root_slab = nullptr;
-        }
-
-        arena(std::size_t initial_size = 1024) noexcept : m_initial_size(initial_size), m_root_slab(new slab(initial_size)) {
-            m_current_slab = m_root_slab;
-        }
-
-        arena(const arena&) = delete;
-        arena& operator=(const arena&) = delete;
-
-        arena::pointer allocate(std::size_t size) {
-            slab *s = nullptr;
-            if (likely(m_current_slab->free() >= size)) {
-                return m_current_slab->allocate(size);
-            } else {
-                if ((s = find_slab_with_space(m_root_slab, size)) != nullptr) {
-                    return s->allocate(size);
-                } else {
-                    m_current_slab->m_next = new slab(std::max(size, m_initial_size));
-                    m_current_slab = m_current_slab->m_next;
-                    return m_current_slab->allocate(size);
-                }
-            }
-        }
+    // mmapped slabs, the current slab tried first; what the rest of the library builds on
+    template <typename Growth = fixed_growth, typename Lock = null_lock> using linear_arena = basic_arena<mapped_slabs, Growth, current_slab_lookup, Lock, no_stats>;
 
-        void deallocate(arena::pointer p, std::size_t size) noexcept {
-            if (m_current_slab->pointer_in_buffer(p)) {
-                m_current_slab->deallocate(p, size);
-            } else {
-                slab *s = find_slab_containing(m_root_slab, p);
-                assert(s != nullptr);
-                if (s != nullptr) {
-                    s->deallocate(p, size);
-                }
-            }
-        }
-
-        friend std::ostream &operator<<(std::ostream &out, const arena &a) {
-            std::size_t block_count = 0;
-            std::size_t total_free = 0;
-            std::size_t total_capacity = 0;
-            std::size_t total_allocated = 0;
-
-            std::function<void(const slab *)> totals = [&](const slab *start) {
-                block_count++;
-                total_free += start->free();
-                total_capacity += start->m_size;
-                total_allocated += start->m_allocated;
-                if (start->m_next != nullptr) {
-                    totals(start->m_next);
-                }
-            };
-
-            totals(a.m_root_slab);
-
-            out << "allocated: " << total_allocated << " capacity: " << total_capacity << " allocatable: " << total_free << " from " << block_count << " blocks";
-            return out;
-        }
-    };
+    using arena = linear_arena<>;
 
     template <typename T, typename Arena = tf::arena> class linear_allocator {
     public:
@@ -195,15 +49,19 @@ namespace tf {
 
         using arena_type = Arena;
 
+        static_assert(is_arena<Arena>::value, "linear_allocator needs an Arena, see arena_traits.h");
+
     private:
 
         typedef char* storage_type;
 
         arena_type &m_arena;
 
+        template <typename U, typename A> friend class linear_allocator;
+
     public:
         template<typename U> struct rebind {
-            typedef linear_allocator<U> other;
+            typedef linear_allocator<U, Arena> other;
         };
 
         linear_allocator(arena_type &arena) : m_arena(arena) {}
@@ -212,12 +70,42 @@ namespace tf {
 
         linear_allocator(const linear_allocator &other) : m_arena(other.m_arena) {}
 
+        template <typename U> linear_allocator(const linear_allocator<U, Arena> &other) : m_arena(other.m_arena) {}
+
         inline pointer allocate(const std::size_t size) noexcept {
-            return reinterpret_cast<pointer>(m_arena.allocate(size));
+            return reinterpret_cast<pointer>(m_arena.allocate(size * sizeof(T)));
+        }
+
+        // storage that is all zero, for arenas with allocate_zeroed
+        inline pointer allocate_zeroed(const std::size_t size) {
+            return reinterpret_cast<pointer>(m_arena.allocate_zeroed(size * sizeof(T)));
+        }
+
+        // storage the caller will overwrite in full, for arenas with allocate_uninit
+        inline pointer allocate_uninit(const std::size_t size) {
+            return reinterpret_cast<pointer>(m_arena.allocate_uninit(size * sizeof(T)));
         }
 
         inline void deallocate(T* p, std::size_t size) noexcept {
-            m_arena.deallocate(reinterpret_cast<typename arena_type::pointer>(p), size);
+            m_arena.deallocate(reinterpret_cast<typename arena_type::pointer>(p), size * sizeof(T));
+        }
+
+        inline void allocate_n(const std::size_t size, const std::size_t count, pointer *out) noexcept {
+            m_arena.allocate_n(size * sizeof(T), count, out);
+        }
+
+        inline void deallocate_n(const pointer *ptrs, const std::size_t size, const std::size_t count) noexcept {
+            m_arena.deallocate_n(ptrs, size * sizeof(T), count);
+        }
+
+        // grow or shrink the allocation at 'p' in place, returns false if it cannot
+        inline bool expand(T* p, const std::size_t old_size, const std::size_t new_size) noexcept {
+            return m_arena.try_expand(reinterpret_cast<typename arena_type::pointer>(p), old_size * sizeof(T), new_size * sizeof(T));
+        }
+
+        // only valid for trivially copyable T, as the contents may be moved with memcpy
+        inline pointer reallocate(T* p, const std::size_t old_size, const std::size_t new_size) noexcept {
+            return reinterpret_cast<pointer>(m_arena.reallocate(reinterpret_cast<typename arena_type::pointer>(p), old_size * sizeof(T), new_size * sizeof(T)));
         }
     };
 
@@ -0,0 +1,134 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_LOCK_POLICY_H
+#define FASTPATH_LOCK_POLICY_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+namespace tf {
+
+    // Lock policies for the arenas. Each is a Lockable (lock, unlock, try_lock), so it
+    // works with std::lock_guard and std::unique_lock.
+
+    inline void cpu_relax() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#endif
+    }
+
+    // no synchronisation at all, for arenas only ever used by one thread
+    struct null_lock {
+        inline void lock() noexcept {}
+        inline void unlock() noexcept {}
+        inline bool try_lock() noexcept { return true; }
+    };
+
+    // Test-and-test-and-set, so waiters spin on their own cached copy of the lock
+    // rather than hammering it with writes, backing off exponentially between
+    // attempts and yielding the CPU once the backoff is at its limit, in case the
+    // holder has been preempted.
+    class spin_lock {
+        static constexpr unsigned max_backoff = 1024;
+
+        std::atomic<bool> m_locked;
+
+    public:
+        spin_lock() noexcept : m_locked(false) {}
+
+        spin_lock(const spin_lock &) = delete;
+        spin_lock &operator=(const spin_lock &) = delete;
+
+        inline void lock() noexcept {
+            unsigned backoff = 1;
+            while (m_locked.exchange(true, std::memory_order_acquire)) {
+                do {
+                    if (backoff < max_backoff) {
+                        for (unsigned i = 0; i < backoff; ++i) {
+                            cpu_relax();
+                        }
+                        backoff <<= 1;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                } while (m_locked.load(std::memory_order_relaxed));
+            }
+        }
+
+        inline bool try_lock() noexcept {
+            return !m_locked.load(std::memory_order_relaxed) && !m_locked.exchange(true, std::memory_order_acquire);
+        }
+
+        inline void unlock() noexcept {
+            m_locked.store(false, std::memory_order_release);
+        }
+    };
+
+    // A fair lock: threads are served in the order they arrived. Only the thread next
+    // in line spins, and only briefly, anyone further back yields straight away: when
+    // there are more threads than cores the one whose turn it is may not be running,
+    // and spinning then just keeps it off the CPU.
+    class ticket_lock {
+        std::atomic<std::uint32_t> m_next;
+        std::atomic<std::uint32_t> m_serving;
+
+    public:
+        ticket_lock() noexcept : m_next(0), m_serving(0) {}
+
+        ticket_lock(const ticket_lock &) = delete;
+        ticket_lock &operator=(const ticket_lock &) = delete;
+
+        inline void lock() noexcept {
+            const std::uint32_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+            unsigned spins = 0;
+            std::uint32_t serving;
+            while ((serving = m_serving.load(std::memory_order_acquire)) != ticket) {
+                if (ticket - serving == 1 && ++spins < 128) {
+                    cpu_relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        inline bool try_lock() noexcept {
+            std::uint32_t serving = m_serving.load(std::memory_order_acquire);
+            return m_next.compare_exchange_strong(serving, serving + 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        inline void unlock() noexcept {
+            m_serving.store(m_serving.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+    };
+
+    using mutex_lock = std::mutex;
+}
+
+#endif //FASTPATH_LOCK_POLICY_H
@@ -3,17 +3,42 @@
 #include <chrono>
 #include <memory>
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <ctime>
 #include <iomanip>
+#include <map>
+#include <numeric>
+#include <list>
+#include <deque>
+#include <fstream>
+#include <unordered_map>
 #include <array>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
 
 #include "fast_linear_allocator.h"
 #include "arena_unoptimised.h"
+#include "optimised_arena.h"
 #include "new_arena.h"
 #include "performance.h"
 #include "short_alloc.h"
 #include "new_delete_allocator.h"
+#include "batch_allocator_traits.h"
+#include "expandable_vector.h"
+#include "epoch_arena.h"
+#include "persistent_arena.h"
+#include "offset_map.h"
+#include "arena_string.h"
+#include "small_vector.h"
+#include "allocation_profiler.h"
+#include "tlsf_arena.h"
+#include "buddy_arena.h"
+#include "deferred_free.h"
+#include "arena_registry.h"
 //#include <boost/pool/pool_alloc.hpp>
 
 static const std::size_t iterations = 10000000;
@@ -33,20 +58,49 @@ static void initialise() {
     }
 }
 
-template <typename A> void testSimpleAllocateDeallocate(A &allocator) {
-    for (std::size_t i = 0; i < iterations; ++i) {
-        auto ptr = std::allocator_traits<A>::allocate(allocator, 100);
+// How the workloads get each block: as it comes, or initialised one way or another
+struct plain_allocate {
+    template <typename A> typename std::allocator_traits<A>::pointer operator()(A &allocator, std::size_t n) const {
+        return std::allocator_traits<A>::allocate(allocator, n);
+    }
+};
+
+// keeps the compiler from dropping stores to a block that is freed without being read
+static inline void escape(void *p) {
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+struct memset_allocate {
+    template <typename A> typename std::allocator_traits<A>::pointer operator()(A &allocator, std::size_t n) const {
+        auto ptr = std::allocator_traits<A>::allocate(allocator, n);
+        std::memset(static_cast<void *>(ptr), 0, n * sizeof(typename std::allocator_traits<A>::value_type));
+        escape(ptr);
+        return ptr;
+    }
+};
+
+struct zeroed_allocate {
+    template <typename A> typename std::allocator_traits<A>::pointer operator()(A &allocator, std::size_t n) const {
+        auto ptr = allocator.allocate_zeroed(n);
+        escape(ptr);
+        return ptr;
+    }
+};
+
+template <typename A, typename Allocate = plain_allocate> void testSimpleAllocateDeallocate(A &allocator, std::size_t rounds = iterations, Allocate allocate = Allocate()) {
+    for (std::size_t i = 0; i < rounds; ++i) {
+        auto ptr = allocate(allocator, 100);
         std::allocator_traits<A>::deallocate(allocator, ptr, 100);
     }
 }
 
-template <typename A> void testSimpleRandomAllocateDeallocate(A &allocator) {
+template <typename A, typename Allocate = plain_allocate> void testSimpleRandomAllocateDeallocate(A &allocator, std::size_t rounds = iterations, Allocate allocate = Allocate()) {
     std::vector<typename std::allocator_traits<A>::pointer> m_allocations;
-    m_allocations.reserve(iterations);
+    m_allocations.reserve(rounds);
 
-    for (std::size_t i = 0; i < iterations; ++i) {
+    for (std::size_t i = 0; i < rounds; ++i) {
         if (add_remove_flags[i]) {
-            m_allocations.push_back(std::allocator_traits<A>::allocate(allocator, 100));
+            m_allocations.push_back(allocate(allocator, 100));
         } else if (m_allocations.size() != 0) {
             size_t index = static_cast<size_t>((static_cast<double>(std::rand()) / RAND_MAX) * m_allocations.size());
             std::allocator_traits<A>::deallocate(allocator, m_allocations[index], 100);
@@ -55,15 +109,15 @@ template <typename A> void testSimpleRandomAllocateDeallocate(A &allocator) {
     }
 }
 
-template <typename A> void testAllocateDeallocateRandomSize(A &allocator) {
+template <typename A, typename Allocate = plain_allocate> void testAllocateDeallocateRandomSize(A &allocator, std::size_t rounds = iterations, Allocate allocate = Allocate()) {
     std::vector<std::pair<std::size_t, typename std::allocator_traits<A>::pointer>> m_allocations;
-    m_allocations.reserve(iterations);
+    m_allocations.reserve(rounds);
 
-    for (std::size_t i = 0; i < iterations; ++i) {
+    for (std::size_t i = 0; i < rounds; ++i) {
         // create anything between 0 and 1k
         std::size_t size = random_allocation_sizes[i];
         if (add_remove_flags[i]) {
-            m_allocations.emplace_back(size, std::allocator_traits<A>::allocate(allocator, size));
+            m_allocations.emplace_back(size, allocate(allocator, size));
         } else if (m_allocations.size() != 0) {
             size_t index = static_cast<size_t>((static_cast<double>(std::rand()) / RAND_MAX) * m_allocations.size());
             auto m = m_allocations[index];
@@ -73,70 +127,215 @@ template <typename A> void testAllocateDeallocateRandomSize(A &allocator) {
     }
 }
 
+static const std::size_t min_batch_size = 64;
+static const std::size_t max_batch_size = 512;
+
+static std::size_t batch_size(std::size_t i) {
+    return min_batch_size + random_allocation_sizes[i] % (max_batch_size - min_batch_size + 1);
+}
+
+template <typename A> struct allocation_batch {
+    std::size_t size;
+    std::size_t count;
+    std::array<typename std::allocator_traits<A>::pointer, max_batch_size> ptrs;
+};
+
+template <typename A> void testBatchAllocateDeallocate(A &allocator) {
+    std::array<typename std::allocator_traits<A>::pointer, max_batch_size> ptrs;
+
+    for (std::size_t i = 0; i < iterations; i += max_batch_size) {
+        tf::batch_allocator_traits<A>::allocate_n(allocator, 100, max_batch_size, ptrs.data());
+        tf::batch_allocator_traits<A>::deallocate_n(allocator, ptrs.data(), 100, max_batch_size);
+    }
+}
+
+template <typename A> void testBatchRandomAllocateDeallocate(A &allocator) {
+    std::vector<allocation_batch<A>> m_allocations;
+    m_allocations.reserve(iterations / min_batch_size);
+
+    for (std::size_t i = 0; i < iterations; i += min_batch_size) {
+        if (add_remove_flags[i]) {
+            m_allocations.emplace_back();
+            allocation_batch<A> &b = m_allocations.back();
+            b.size = 100;
+            b.count = batch_size(i);
+            tf::batch_allocator_traits<A>::allocate_n(allocator, b.size, b.count, b.ptrs.data());
+        } else if (m_allocations.size() != 0) {
+            size_t index = static_cast<size_t>((static_cast<double>(std::rand()) / RAND_MAX) * m_allocations.size());
+            allocation_batch<A> &b = m_allocations[index];
+            tf::batch_allocator_traits<A>::deallocate_n(allocator, b.ptrs.data(), b.size, b.count);
+            m_allocations.erase(m_allocations.begin() + index);
+        }
+    }
+}
+
+template <typename A> void testBatchAllocateDeallocateRandomSize(A &allocator) {
+    std::vector<allocation_batch<A>> m_allocations;
+    m_allocations.reserve(iterations / min_batch_size);
+
+    for (std::size_t i = 0; i < iterations; i += min_batch_size) {
+        if (add_remove_flags[i]) {
+            m_allocations.emplace_back();
+            allocation_batch<A> &b = m_allocations.back();
+            b.size = random_allocation_sizes[i + 1];
+            b.count = batch_size(i);
+            tf::batch_allocator_traits<A>::allocate_n(allocator, b.size, b.count, b.ptrs.data());
+        } else if (m_allocations.size() != 0) {
+            size_t index = static_cast<size_t>((static_cast<double>(std::rand()) / RAND_MAX) * m_allocations.size());
+            allocation_batch<A> &b = m_allocations[index];
+            tf::batch_allocator_traits<A>::deallocate_n(allocator, b.ptrs.data(), b.size, b.count);
+            m_allocations.erase(m_allocations.begin() + index);
+        }
+    }
+}
+
+template <typename T> std::size_t pushBackRounds() {
+    return std::max<std::size_t>(16, iterations / 1024 / sizeof(T));
+}
+
+template <typename V, typename A> void testPushBack(A &allocator) {
+    using T = typename V::value_type;
+    for (std::size_t i = 0; i < pushBackRounds<T>(); ++i) {
+        V v(allocator);
+        for (std::size_t j = 0; j < random_allocation_sizes[i]; ++j) {
+            v.push_back(T());
+        }
+    }
+}
+
+// two buffers growing in turn, so neither stays the last block in its slab
+template <typename V, typename A> void testInterleavedPushBack(A &allocator) {
+    using T = typename V::value_type;
+    for (std::size_t i = 0; i < pushBackRounds<T>(); ++i) {
+        V a(allocator);
+        V b(allocator);
+        for (std::size_t j = 0; j < random_allocation_sizes[i]; ++j) {
+            a.push_back(T());
+            b.push_back(T());
+        }
+    }
+}
+
+static void logTime(const std::chrono::microseconds &time) {
+    auto t = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time);
+    std::cout << std::setw(27) << std::setprecision(4) << std::fixed << std::right << t.count() << " ms";
+}
+
+template <typename A> void runTests(const std::string &name, A &allocator) {
+
+    std::cout << std::left << std::setw(60) << name.substr(0, 60);
+
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleAllocateDeallocate(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleRandomAllocateDeallocate(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testAllocateDeallocateRandomSize(allocator); }));
+
+    std::cout << std::endl;
+}
+
 template <typename A> void runTests(A &allocator) {
+    runTests(typeid(A).name(), allocator);
+}
 
-    std::cout << std::left << std::setw(60) << std::string(typeid(A).name()).substr(0, 60);
+template <typename A> void runBatchTests(A &allocator) {
 
-    auto logger = [&](const std::chrono::microseconds &time) {
-        auto t = std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(time);
-        std::cout << std::setw(27) << std::setprecision(4) << std::fixed << std::right << t.count() << " ms";
-    };
+    std::cout << std::left << std::setw(60) << std::string(typeid(A).name()).substr(0, 60);
 
-    logger(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleAllocateDeallocate(allocator); }));
-    logger(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleRandomAllocateDeallocate(allocator); }));
-    logger(tf::measure<std::chrono::microseconds>::execution([&]() { testAllocateDeallocateRandomSize(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testBatchAllocateDeallocate(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testBatchRandomAllocateDeallocate(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testBatchAllocateDeallocateRandomSize(allocator); }));
 
     std::cout << std::endl;
 }
 
-template <typename T> void testForType(const char *type) {
+template <typename A> void runPushBackTests(A &allocator) {
+    using T = typename A::value_type;
 
-    static const std::size_t pre_alloc_size = 1024 * 1024;
+    std::cout << std::left << std::setw(60) << std::string(typeid(A).name()).substr(0, 60);
 
-    std::cout << std::endl << "=====================" << std::endl;
-    std::cout << " Testing " << type << " (" << sizeof(T) << ")"<< std::endl;
-    std::cout << "=====================" << std::endl;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testPushBack<std::vector<T, A>>(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testPushBack<tf::expandable_vector<T, A>>(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testInterleavedPushBack<std::vector<T, A>>(allocator); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testInterleavedPushBack<tf::expandable_vector<T, A>>(allocator); }));
+
+    std::cout << std::endl;
+}
 
+static void printHeader(const std::vector<std::string> &tests) {
     std::cout << std::left << std::setw(60) << "Allocator Type";
-    std::vector<std::string> tests = {"AllocateDeallocate", "RandomAllocationDeallocate", "AllocateDeallocateRandomSize"};
     for (const std::string &test : tests) {
         std::cout << std::setw(30) << std::setprecision(3) << std::right << test;
     }
     std::cout << std::endl;
+}
+
+template <typename T, template <typename> class Runner> void runAllocators() {
 
+    static const std::size_t pre_alloc_size = 1024 * 1024;
 
     {
         std::allocator<T> allocator;
-        runTests(allocator);
+        Runner<std::allocator<T>>::run(allocator);
     }
 
     {
         new_delete_allocator<T> allocator;
-        runTests(allocator);
+        Runner<new_delete_allocator<T>>::run(allocator);
+    }
+
+    {
+        new_delete_allocator<T, new_delete_mode::raw> allocator;
+        Runner<new_delete_allocator<T, new_delete_mode::raw>>::run(allocator);
+    }
+
+    {
+        new_delete_allocator<T, new_delete_mode::sized> allocator;
+        Runner<new_delete_allocator<T, new_delete_mode::sized>>::run(allocator);
+    }
+
+    {
+        new_delete_allocator<T, new_delete_mode::aligned> allocator;
+        Runner<new_delete_allocator<T, new_delete_mode::aligned>>::run(allocator);
+    }
+
+    {
+        new_delete_allocator<T, new_delete_mode::usable_size> allocator;
+        Runner<new_delete_allocator<T, new_delete_mode::usable_size>>::run(allocator);
     }
 
     {
         typename tf::linear_allocator<T>::arena_type arena(pre_alloc_size);
         typename tf::linear_allocator<T> allocator(arena);
-        runTests(allocator);
+        Runner<tf::linear_allocator<T>>::run(allocator);
     }
 
     {
         typename tf::linear_allocator<T, tf::arena_unoptimised>::arena_type arena(pre_alloc_size);
         typename tf::linear_allocator<T, tf::arena_unoptimised> allocator(arena);
-        runTests(allocator);
+        Runner<tf::linear_allocator<T, tf::arena_unoptimised>>::run(allocator);
+    }
+
+    {
+        typename tf::linear_allocator<T, tf::optimised_arena>::arena_type arena(pre_alloc_size);
+        typename tf::linear_allocator<T, tf::optimised_arena> allocator(arena);
+        Runner<tf::linear_allocator<T, tf::optimised_arena>>::run(allocator);
     }
 
     {
         typename tf::linear_allocator<T, tf::new_arena<pre_alloc_size>>::arena_type arena;
         typename tf::linear_allocator<T, tf::new_arena<pre_alloc_size>> allocator(arena);
-        runTests(allocator);
+        Runner<tf::linear_allocator<T, tf::new_arena<pre_alloc_size>>>::run(allocator);
+    }
+
+    {
+        typename tf::linear_allocator<T, tf::tlsf_arena<>>::arena_type arena(pre_alloc_size);
+        typename tf::linear_allocator<T, tf::tlsf_arena<>> allocator(arena);
+        Runner<tf::linear_allocator<T, tf::tlsf_arena<>>>::run(allocator);
     }
 
     {
         typename short_alloc<T, 4096>::arena_type  arena;
         short_alloc<T, 4096> allocator(arena);
-        runTests(allocator);
+        Runner<short_alloc<T, 4096>>::run(allocator);
     }
 
 //    {
@@ -150,30 +349,1594 @@ template <typename T> void testForType(const char *type) {
 ////    }
 }
 
-#define TEST(x) testForType<x>(#x)
+template <typename A> struct standard_tests {
+    static void run(A &allocator) { runTests(allocator); }
+};
 
-int main() {
+template <typename A> struct batch_tests {
+    static void run(A &allocator) { runBatchTests(allocator); }
+};
 
-    initialise();
+template <typename A> struct push_back_tests {
+    static void run(A &allocator) { runPushBackTests(allocator); }
+};
 
-    struct small_obj {
-        char data[200];
-        int a;
-        bool b;
-        float c;
-    };
+template <typename T> void testForType(const char *type) {
 
-    struct large_obj {
-        char data[3456];
-        int data2[1234];
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing " << type << " (" << sizeof(T) << ")"<< std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocate", "RandomAllocationDeallocate", "AllocateDeallocateRandomSize"});
+    runAllocators<T, standard_tests>();
+
+    std::cout << std::endl;
+    printHeader({"BatchAllocateDeallocate", "BatchRandomAllocDealloc", "BatchAllocDeallocRandomSize"});
+    runAllocators<T, batch_tests>();
+
+    std::cout << std::endl;
+    printHeader({"VectorPushBack", "ExpandablePushBack", "VectorInterleaved", "ExpandableInterleaved"});
+    runAllocators<T, push_back_tests>();
+}
+
+static const std::size_t generation_objects = 1000;
+static const std::size_t generation_lifetime = 4;
+static const std::size_t survivor_interval = 100;
+static const std::size_t survivor_lifetime = 64;
+
+// Objects allocated on each tick mostly die 'generation_lifetime' ticks later, but
+// one in 'survivor_interval' lives for 'survivor_lifetime' ticks instead.
+template <typename A, typename Tick, typename Report> void testGenerationalLifetimes(A &allocator, Tick tick, Report report) {
+    using pointer = typename std::allocator_traits<A>::pointer;
+    std::vector<std::vector<std::pair<std::size_t, pointer>>> generations(generation_lifetime);
+    std::vector<std::vector<std::pair<std::size_t, pointer>>> survivors(survivor_lifetime);
+
+    auto release = [&](std::vector<std::pair<std::size_t, pointer>> &allocations) {
+        for (auto &a : allocations) {
+            std::allocator_traits<A>::deallocate(allocator, a.second, a.first);
+        }
+        allocations.clear();
     };
 
-    TEST(char);
-    TEST(uint32_t);
-    TEST(uint64_t);
-    TEST(double);
-    TEST(small_obj);
-    TEST(large_obj);
+    const std::size_t ticks = iterations / generation_objects;
+    for (std::size_t t = 0; t < ticks; ++t) {
+        release(generations[t % generation_lifetime]);
+        release(survivors[t % survivor_lifetime]);
+
+        for (std::size_t i = 0; i < generation_objects; ++i) {
+            const std::size_t n = t * generation_objects + i;
+            const std::size_t size = random_allocation_sizes[n];
+            auto &lifetime = n % survivor_interval == 0 ? survivors[t % survivor_lifetime] : generations[t % generation_lifetime];
+            lifetime.emplace_back(size, std::allocator_traits<A>::allocate(allocator, size));
+        }
+        tick();
+    }
+
+    report();
+
+    for (auto &g : generations) {
+        release(g);
+    }
+    for (auto &g : survivors) {
+        release(g);
+    }
+}
+
+static void testGenerational() {
+
+    static const std::size_t pre_alloc_size = 1024 * 1024;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing generational lifetimes" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"GenerationalLifetimes"});
+
+    {
+        std::allocator<char> allocator;
+        std::cout << std::left << std::setw(60) << "std::allocator";
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testGenerationalLifetimes(allocator, []() {}, []() {}); }));
+        std::cout << std::endl;
+    }
+
+    {
+        tf::arena arena(pre_alloc_size);
+        tf::linear_allocator<char> allocator(arena);
+        std::ostringstream stats;
+        std::cout << std::left << std::setw(60) << "tf::arena";
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            testGenerationalLifetimes(allocator, []() {}, [&]() { stats << arena; });
+        }));
+        std::cout << std::endl << "    " << stats.str() << std::endl;
+    }
+
+    {
+        tf::epoch_arena arena(pre_alloc_size);
+        tf::linear_allocator<char, tf::epoch_arena> allocator(arena);
+        std::ostringstream stats;
+        std::cout << std::left << std::setw(60) << "tf::epoch_arena";
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            testGenerationalLifetimes(allocator, [&]() { arena.advance_epoch(); }, [&]() {
+                stats << arena << ", " << arena.surviving_epochs() << " epochs surviving" << std::endl;
+                // anything older than the longest intended lifetime is a leak
+                arena.report_survivors(stats, survivor_lifetime + 1);
+            });
+        }));
+        std::cout << std::endl << "    " << stats.str();
+    }
+}
+
+static const std::size_t burst_rounds = 2000;
+static const std::size_t burst_small = 64;
+static const std::size_t burst_large = 4096;
+
+// Each thread alternates small and large bursts of allocations, freeing each burst
+// before the next. Threads peak at different times, so slabs one thread has just
+// emptied are exactly what another needs.
+template <typename Arena> void testThreadedBursts(std::size_t thread_count) {
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([t]() {
+            Arena arena;
+            tf::linear_allocator<char, Arena> allocator(arena);
+            std::vector<char *> burst;
+            burst.reserve(burst_large);
+            for (std::size_t r = 0; r < burst_rounds; ++r) {
+                const std::size_t count = (r + t) % 4 == 0 ? burst_large : burst_small;
+                for (std::size_t i = 0; i < count; ++i) {
+                    burst.push_back(allocator.allocate(512));
+                }
+                for (char *p : burst) {
+                    allocator.deallocate(p, 512);
+                }
+                burst.clear();
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+template <typename Arena> void runThreadedBursts(const char *name, std::size_t thread_count) {
+    Arena::reset_peak();
+    const std::size_t mallocs = Arena::slab_mallocs();
+
+    std::cout << std::left << std::setw(60) << std::string(name) + " x " + std::to_string(thread_count);
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testThreadedBursts<Arena>(thread_count); }));
+    std::cout << std::setw(30) << std::right << Arena::slab_mallocs() - mallocs;
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << Arena::peak_reserved_bytes() / (1024.0 * 1024.0) << " MB";
+    std::cout << std::endl;
+
+    Arena::trim();
+}
+
+static void testThreads() {
+
+    static const std::size_t slab_size = 64 * 1024;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing threaded bursts" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"ThreadedBursts", "SlabMallocs", "PeakFootprint"});
+
+    const std::size_t max_threads = std::max<std::size_t>(8, std::thread::hardware_concurrency());
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        runThreadedBursts<tf::new_arena<slab_size>>("tf::new_arena", threads);
+        runThreadedBursts<tf::new_arena<slab_size, tf::slab_exchange<>>>("tf::new_arena + slab_exchange", threads);
+    }
+}
+
+// Allocation in the pattern of a parser or request handler: blocks are written as
+// soon as they are handed out and freed most recently allocated first, so the cost
+// is dominated by which cache lines the allocator itself has to touch.
+template <typename A> void testCacheTouch(A &allocator) {
+    std::vector<std::pair<std::size_t, typename std::allocator_traits<A>::pointer>> m_allocations;
+    m_allocations.reserve(iterations);
+
+    for (std::size_t i = 0; i < iterations; ++i) {
+        if (add_remove_flags[i]) {
+            const std::size_t size = random_allocation_sizes[i] / 4 + 1;
+            auto ptr = std::allocator_traits<A>::allocate(allocator, size);
+            *ptr = static_cast<typename std::allocator_traits<A>::value_type>(i);
+            m_allocations.emplace_back(size, ptr);
+        } else if (m_allocations.size() != 0) {
+            auto m = m_allocations.back();
+            std::allocator_traits<A>::deallocate(allocator, m.second, m.first);
+            m_allocations.pop_back();
+        }
+    }
+}
+
+template <typename Arena> void runCacheTouch(const char *name, Arena &arena) {
+    tf::linear_allocator<char, Arena> allocator(arena);
+    tf::l1d_miss_counter counter;
+    std::uint64_t misses = 0;
+
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        misses = counter.execution([&]() { testCacheTouch(allocator); });
+    }));
+    if (counter.available()) {
+        std::cout << std::setw(30) << std::setprecision(4) << std::fixed << std::right << static_cast<double>(misses) / iterations;
+    } else {
+        std::cout << std::setw(30) << std::right << "n/a";
+    }
+    std::cout << std::endl;
+}
+
+// Slab lookups and header layouts: headers packed a cache line each into pages and
+// every lookup walking the chain (tf::arena_unoptimised) or trying the current slab
+// first (tf::arena), and headers at the front of their own slab (tf::new_arena).
+// Small slabs make the slab walks frequent, which is where the layout shows.
+static void testCache() {
+
+    static const std::size_t slab_size = 4096;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing slab cache footprint" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"CacheTouch", "L1DMissesPerOp"});
+
+    {
+        tf::arena_unoptimised arena(slab_size);
+        runCacheTouch("tf::arena_unoptimised", arena);
+    }
+
+    {
+        tf::arena arena(slab_size);
+        runCacheTouch("tf::arena", arena);
+    }
+
+    {
+        tf::new_arena<slab_size> arena;
+        runCacheTouch("tf::new_arena", arena);
+    }
+}
+
+static const std::size_t request_count = 100000;
+static const std::size_t request_passes = 10;
+static const std::size_t response_pieces = 200;
+
+// keeps the parsed and built results from being optimised away
+static volatile std::size_t parse_sink;
+
+// query-string style requests of 4-12 fields, "key=value&key=value...", with keys
+// of 3-10 characters and values of 1-40
+static std::vector<std::string> makeRequests() {
+    std::vector<std::string> requests;
+    requests.reserve(request_count);
+    for (std::size_t i = 0; i < request_count; ++i) {
+        std::string request;
+        const std::size_t fields = 4 + std::rand() % 9;
+        for (std::size_t f = 0; f < fields; ++f) {
+            if (f != 0) {
+                request += '&';
+            }
+            request.append(3 + std::rand() % 8, static_cast<char>('a' + f));
+            request += '=';
+            request.append(1 + std::rand() % 40, static_cast<char>('A' + std::rand() % 26));
+        }
+        requests.push_back(std::move(request));
+    }
+    return requests;
+}
+
+// split a request into fields and build a "key: value" response from them,
+// creating strings and a vector of a given type through 'make'
+template <typename Request, typename Fields, typename MakeString> std::size_t parseAndBuild(const std::string &line, Fields &fields, MakeString make) {
+    const char *p = line.data();
+    const char *end = p + line.size();
+    while (p < end) {
+        const char *eq = static_cast<const char *>(std::memchr(p, '=', static_cast<std::size_t>(end - p)));
+        const char *amp = static_cast<const char *>(std::memchr(eq, '&', static_cast<std::size_t>(end - eq)));
+        if (amp == nullptr) {
+            amp = end;
+        }
+        fields.emplace_back(make(p, static_cast<std::size_t>(eq - p)), make(eq + 1, static_cast<std::size_t>(amp - eq - 1)));
+        p = amp + 1;
+    }
+
+    Request response = make("", 0);
+    for (const auto &field : fields) {
+        response += field.first;
+        response += ": ";
+        response += field.second;
+        response += '\n';
+    }
+    return response.size();
+}
+
+template <typename Request> std::size_t concatenate(const std::string &line, Request response) {
+    for (std::size_t i = 0; i < response_pieces; ++i) {
+        response.append(line.data(), 1 + i % 16);
+    }
+    return response.size();
+}
+
+static void testStringsStd(const std::vector<std::string> &requests) {
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            std::vector<std::pair<std::string, std::string>> fields;
+            total += parseAndBuild<std::string>(line, fields, [](const char *s, std::size_t n) { return std::string(s, n); });
+        }
+    }
+    parse_sink = total;
+}
+
+static void testConcatenateStd(const std::vector<std::string> &requests) {
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            total += concatenate(line, std::string());
+        }
+    }
+    parse_sink = total;
+}
+
+static const std::size_t short_arena_size = 16384;
+using short_string = std::basic_string<char, std::char_traits<char>, short_alloc<char, short_arena_size>>;
+
+static void testStringsShortAlloc(const std::vector<std::string> &requests) {
+    using field_allocator = short_alloc<std::pair<short_string, short_string>, short_arena_size>;
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            short_alloc<char, short_arena_size>::arena_type arena;
+            short_alloc<char, short_arena_size> allocator(arena);
+            std::vector<std::pair<short_string, short_string>, field_allocator> fields{field_allocator(arena)};
+            total += parseAndBuild<short_string>(line, fields, [&](const char *s, std::size_t n) { return short_string(s, n, allocator); });
+        }
+    }
+    parse_sink = total;
+}
+
+static void testConcatenateShortAlloc(const std::vector<std::string> &requests) {
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            short_alloc<char, short_arena_size>::arena_type arena;
+            total += concatenate(line, short_string(short_alloc<char, short_arena_size>(arena)));
+        }
+    }
+    parse_sink = total;
+}
+
+static void testStringsArena(const std::vector<std::string> &requests) {
+    using field_allocator = tf::linear_allocator<std::pair<tf::arena_string, tf::arena_string>>;
+    tf::arena arena(64 * 1024);
+    tf::linear_allocator<char> allocator(arena);
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            tf::small_vector<std::pair<tf::arena_string, tf::arena_string>, 8, field_allocator> fields{field_allocator(arena)};
+            total += parseAndBuild<tf::arena_string>(line, fields, [&](const char *s, std::size_t n) { return tf::arena_string(s, n, allocator); });
+        }
+    }
+    parse_sink = total;
+}
+
+static void testConcatenateArena(const std::vector<std::string> &requests) {
+    tf::arena arena(64 * 1024);
+    tf::linear_allocator<char> allocator(arena);
+    std::size_t total = 0;
+    for (std::size_t pass = 0; pass < request_passes; ++pass) {
+        for (const std::string &line : requests) {
+            total += concatenate(line, tf::arena_string(allocator));
+        }
+    }
+    parse_sink = total;
+}
+
+static void testStrings() {
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing strings and small vectors" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"ParseAndBuild", "Concatenate"});
+
+    const std::vector<std::string> requests = makeRequests();
+
+    std::cout << std::left << std::setw(60) << "std::string + std::vector";
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testStringsStd(requests); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testConcatenateStd(requests); }));
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(60) << "std::string + std::vector with short_alloc";
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testStringsShortAlloc(requests); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testConcatenateShortAlloc(requests); }));
+    std::cout << std::endl;
+
+    std::cout << std::left << std::setw(60) << "tf::arena_string + tf::small_vector";
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testStringsArena(requests); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testConcatenateArena(requests); }));
+    std::cout << std::endl;
+}
+
+static const std::size_t burst_cycles = 200;
+static const std::size_t burst_blocks = 64 * 1024;
+static const std::size_t burst_block_size = 256;
+static const std::size_t quiet_blocks = 64;
+
+// Bursts of 16MB of short lived blocks, each followed by a quiet spell of a few
+// small allocations, during which the resident set is sampled. What the arena
+// still holds between bursts is what a mostly idle service pays for its peaks.
+template <typename A> void testBursts(A &allocator, std::size_t baseline, std::size_t &quiet, std::size_t &peak) {
+    std::vector<typename std::allocator_traits<A>::pointer> blocks;
+    blocks.reserve(burst_blocks);
+    std::size_t quiet_total = 0;
+    peak = 0;
+    for (std::size_t c = 0; c < burst_cycles; ++c) {
+        for (std::size_t i = 0; i < burst_blocks; ++i) {
+            blocks.push_back(std::allocator_traits<A>::allocate(allocator, burst_block_size));
+            *blocks.back() = static_cast<typename std::allocator_traits<A>::value_type>(i);
+        }
+        peak = std::max(peak, tf::resident_bytes() - baseline);
+        while (!blocks.empty()) {
+            std::allocator_traits<A>::deallocate(allocator, blocks.back(), burst_block_size);
+            blocks.pop_back();
+        }
+
+        for (std::size_t i = 0; i < quiet_blocks; ++i) {
+            blocks.push_back(std::allocator_traits<A>::allocate(allocator, 64));
+        }
+        quiet_total += tf::resident_bytes() - baseline;
+        while (!blocks.empty()) {
+            std::allocator_traits<A>::deallocate(allocator, blocks.back(), 64);
+            blocks.pop_back();
+        }
+    }
+    quiet = quiet_total / burst_cycles;
+}
+
+template <typename Arena, typename Make> void runBursts(const char *name, Make make) {
+    std::size_t quiet = 0;
+    std::size_t peak = 0;
+    const std::size_t baseline = tf::resident_bytes();
+
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::unique_ptr<Arena> arena(make());
+        tf::linear_allocator<char, Arena> allocator(*arena);
+        testBursts(allocator, baseline, quiet, peak);
+    }));
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << quiet / (1024.0 * 1024.0) << " MB";
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << peak / (1024.0 * 1024.0) << " MB";
+    std::cout << std::endl;
+}
+
+static void testCommit() {
+
+    static const std::size_t slab_size = 1024 * 1024;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing lazy commit" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"Bursts", "QuietRSS", "PeakRSS"});
+
+    const tf::commit_policy dontneed(64 * 1024, 64 * 1024, 256 * 1024, MADV_DONTNEED);
+    const tf::commit_policy lazy;
+
+    runBursts<tf::arena>("tf::arena, malloc slabs", [&]() { return new tf::arena(slab_size, tf::commit_policy::never()); });
+    runBursts<tf::arena>("tf::arena, MADV_DONTNEED", [&]() { return new tf::arena(slab_size, dontneed); });
+    runBursts<tf::arena>("tf::arena, MADV_FREE", [&]() { return new tf::arena(slab_size, lazy); });
+
+    using new_arena_type = tf::new_arena<slab_size>;
+    new_arena_type::set_commit_policy(tf::commit_policy::never());
+    runBursts<new_arena_type>("tf::new_arena, malloc slabs", [&]() { return new new_arena_type(); });
+    new_arena_type::set_commit_policy(dontneed);
+    runBursts<new_arena_type>("tf::new_arena, MADV_DONTNEED", [&]() { return new new_arena_type(); });
+    new_arena_type::set_commit_policy(lazy);
+    runBursts<new_arena_type>("tf::new_arena, MADV_FREE", [&]() { return new new_arena_type(); });
+}
+
+static const std::size_t growth_blocks = 25000;
+
+// Demand that ramps up, drops away, then returns at an eighth of the size, from
+// an arena started with small slabs: the slab count and the time spent walking
+// the slabs both follow from the growth policy.
+template <typename A> void testGrowth(A &allocator) {
+    std::vector<std::pair<std::size_t, typename std::allocator_traits<A>::pointer>> blocks;
+    blocks.reserve(growth_blocks);
+    for (std::size_t phase = 0; phase < 4; ++phase) {
+        const std::size_t count = phase % 2 == 0 ? growth_blocks : growth_blocks / 8;
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::size_t size = random_allocation_sizes[i] + 1;
+            blocks.emplace_back(size, std::allocator_traits<A>::allocate(allocator, size));
+        }
+        while (!blocks.empty()) {
+            std::allocator_traits<A>::deallocate(allocator, blocks.back().second, blocks.back().first);
+            blocks.pop_back();
+        }
+    }
+}
+
+template <typename Arena, typename Count> void runGrowth(const char *name, Arena &arena, Count count) {
+    tf::linear_allocator<char, Arena> allocator(arena);
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testGrowth(allocator); }));
+    std::cout << std::setw(30) << std::right << count();
+    std::cout << std::endl;
+}
+
+static void testGrowthPolicies() {
+
+    static const std::size_t slab_size = 4096;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing slab growth" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"RampAndDrop", "Slabs"});
+
+    {
+        tf::linear_arena<tf::fixed_growth> arena(slab_size);
+        runGrowth("tf::arena, fixed", arena, [&]() { return arena.slab_count(); });
+    }
+
+    {
+        tf::linear_arena<tf::geometric_growth<>> arena(slab_size);
+        runGrowth("tf::arena, geometric", arena, [&]() { return arena.slab_count(); });
+    }
+
+    {
+        tf::linear_arena<tf::adaptive_growth<>> arena(slab_size);
+        runGrowth("tf::arena, adaptive", arena, [&]() { return arena.slab_count(); });
+    }
+
+    {
+        using arena_type = tf::new_arena<slab_size, tf::no_slab_exchange, tf::fixed_growth>;
+        arena_type arena;
+        const std::size_t mallocs = arena_type::slab_mallocs();
+        runGrowth("tf::new_arena, fixed", arena, [&]() { return arena_type::slab_mallocs() - mallocs; });
+    }
+
+    {
+        using arena_type = tf::new_arena<slab_size, tf::no_slab_exchange, tf::geometric_growth<>>;
+        arena_type arena;
+        const std::size_t mallocs = arena_type::slab_mallocs();
+        runGrowth("tf::new_arena, geometric", arena, [&]() { return arena_type::slab_mallocs() - mallocs; });
+    }
+
+    {
+        using arena_type = tf::new_arena<slab_size, tf::no_slab_exchange, tf::adaptive_growth<>>;
+        arena_type arena;
+        const std::size_t mallocs = arena_type::slab_mallocs();
+        runGrowth("tf::new_arena, adaptive", arena, [&]() { return arena_type::slab_mallocs() - mallocs; });
+    }
+}
+
+static const std::size_t contention_operations = 1000000;
+
+// Every thread allocates and frees random sized blocks through the same allocator,
+// holding on to a handful of blocks at a time so frees are not always of the block
+// just allocated.
+template <typename A> void testContention(A &allocator, std::size_t thread_count) {
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&allocator, t, thread_count]() {
+            std::vector<std::pair<std::size_t, char *>> live;
+            live.reserve(16);
+            const std::size_t operations = contention_operations / thread_count;
+            for (std::size_t i = 0; i < operations; ++i) {
+                const std::size_t n = (i * thread_count + t) % iterations;
+                if (live.size() < 16 && (live.empty() || add_remove_flags[n])) {
+                    const std::size_t size = random_allocation_sizes[n];
+                    live.emplace_back(size, allocator.allocate(size));
+                } else {
+                    allocator.deallocate(live.back().second, live.back().first);
+                    live.pop_back();
+                }
+            }
+            for (auto &block : live) {
+                allocator.deallocate(block.second, block.first);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+template <typename A> void runContention(const char *name, A &allocator, std::size_t thread_count) {
+    std::cout << std::left << std::setw(60) << std::string(name) + " x " + std::to_string(thread_count);
+    const auto us = tf::measure<std::chrono::microseconds>::execution([&]() { testContention(allocator, thread_count); });
+    logTime(us);
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << contention_operations / static_cast<double>(std::max<std::chrono::microseconds::rep>(us.count(), 1)) << " Mops";
+    std::cout << std::endl;
+}
+
+template <typename Lock> void runLockedArena(const char *name, std::size_t thread_count) {
+    tf::linear_arena<tf::fixed_growth, Lock> arena(1024 * 1024);
+    tf::linear_allocator<char, tf::linear_arena<tf::fixed_growth, Lock>> allocator(arena);
+    runContention(name, allocator, thread_count);
+}
+
+// One arena shared by a growing number of threads, under each lock policy
+static void testContention() {
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing shared arena contention" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocate", "Throughput"});
+
+    {
+        std::allocator<char> allocator;
+        runContention("std::allocator", allocator, 1);
+    }
+    runLockedArena<tf::null_lock>("tf::arena<null_lock>", 1);
+
+    const std::size_t max_threads = std::max<std::size_t>(8, std::thread::hardware_concurrency());
+    for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+        if (threads > 1) {
+            std::allocator<char> allocator;
+            runContention("std::allocator", allocator, threads);
+        }
+        runLockedArena<tf::spin_lock>("tf::arena<spin_lock>", threads);
+        runLockedArena<tf::ticket_lock>("tf::arena<ticket_lock>", threads);
+        runLockedArena<tf::mutex_lock>("tf::arena<mutex_lock>", threads);
+    }
+}
+
+// What the sampling profiler costs, stopped and at two sample rates, and what it
+// finds: the AllocateDeallocateRandomSize pattern through a tf::arena.
+static void testProfiler() {
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing allocation profiler overhead" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocateRandomSize", "Sites"});
+
+    const std::pair<const char *, std::size_t> rates[] = {{"tf::arena, profiler stopped", 0}, {"tf::arena, sampling every 512 KiB", 512 * 1024}, {"tf::arena, sampling every 4 KiB", 4 * 1024}};
+    for (const auto &rate : rates) {
+        tf::allocation_profiler::reset();
+        if (rate.second != 0) {
+            tf::allocation_profiler::start(rate.second);
+        }
+        tf::arena arena(1024 * 1024);
+        tf::allocation_profiler::name_arena(&arena, "benchmark arena");
+        tf::linear_allocator<char> allocator(arena);
+        std::cout << std::left << std::setw(60) << rate.first;
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testAllocateDeallocateRandomSize(allocator); }));
+        std::cout << std::setw(30) << std::right << tf::allocation_profiler::site_count();
+        std::cout << std::endl;
+        tf::allocation_profiler::stop();
+    }
+
+    std::cout << std::endl;
+    tf::allocation_profiler::write_report(std::cout, tf::allocation_profiler::allocated_bytes, 1, 4);
+    tf::allocation_profiler::reset();
+}
+
+// Fewer rounds for the larger types, every block is written in full
+template <typename T> std::size_t zeroedRounds() {
+    return std::max<std::size_t>(2000, iterations / sizeof(T));
+}
+
+template <typename A, typename Allocate> void runZeroed(const char *name, A &allocator, Allocate allocate) {
+    using T = typename std::allocator_traits<A>::value_type;
+    const std::size_t rounds = zeroedRounds<T>();
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleAllocateDeallocate(allocator, rounds, allocate); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleRandomAllocateDeallocate(allocator, rounds, allocate); }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { testAllocateDeallocateRandomSize(allocator, rounds, allocate); }));
+    std::cout << std::endl;
+}
+
+// The standard workloads with every block zeroed as it is handed out, by memset
+// after allocating and by the arenas' allocate_zeroed, which skips whatever part of
+// a block lies on pages no allocation has touched since they were mapped
+template <typename T> void testZeroed(const char *type) {
+
+    static const std::size_t slab_size = 1024 * 1024;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing zeroed " << type << " (" << sizeof(T) << ") x " << zeroedRounds<T>() << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocate", "RandomAllocationDeallocate", "AllocateDeallocateRandomSize"});
+
+    {
+        std::allocator<T> allocator;
+        runZeroed("std::allocator, memset", allocator, memset_allocate());
+    }
+    {
+        tf::arena arena(slab_size);
+        tf::linear_allocator<T> allocator(arena);
+        runZeroed("tf::arena, uninitialised", allocator, plain_allocate());
+    }
+    {
+        tf::arena arena(slab_size);
+        tf::linear_allocator<T> allocator(arena);
+        runZeroed("tf::arena, memset", allocator, memset_allocate());
+    }
+    {
+        tf::arena arena(slab_size);
+        tf::linear_allocator<T> allocator(arena);
+        runZeroed("tf::arena, allocate_zeroed", allocator, zeroed_allocate());
+    }
+    {
+        tf::new_arena<slab_size> arena;
+        tf::linear_allocator<T, tf::new_arena<slab_size>> allocator(arena);
+        runZeroed("tf::new_arena, memset", allocator, memset_allocate());
+    }
+    {
+        tf::new_arena<slab_size> arena;
+        tf::linear_allocator<T, tf::new_arena<slab_size>> allocator(arena);
+        runZeroed("tf::new_arena, allocate_zeroed", allocator, zeroed_allocate());
+    }
+}
+
+static const std::size_t fragmentation_operations = 2000000;
+static const std::size_t fragmentation_floor = 4096;
+
+// Random sizes freed in random order, always keeping at least a few thousand blocks
+// live, removing by swapping with the last so the bookkeeping stays O(1). Reports
+// the arena's reserve against the bytes actually requested and still live.
+template <typename Arena> void runFragmentation(const char *name, Arena &arena, std::size_t scale) {
+    tf::linear_allocator<char, Arena> allocator(arena);
+    std::vector<std::pair<std::size_t, char *>> live;
+    live.reserve(fragmentation_operations);
+    std::size_t live_bytes = 0;
+    std::size_t peak_reserved = 0;
+
+    std::cout << std::left << std::setw(60) << name;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        for (std::size_t i = 0; i < fragmentation_operations; ++i) {
+            const std::size_t n = i % iterations;
+            if (live.size() < fragmentation_floor || add_remove_flags[n]) {
+                const std::size_t size = random_allocation_sizes[n] * scale;
+                live.emplace_back(size, allocator.allocate(size));
+                live_bytes += size;
+            } else {
+                const std::size_t index = random_allocation_sizes[(n * 7) % iterations] * live.size() / 1025;
+                allocator.deallocate(live[index].second, live[index].first);
+                live_bytes -= live[index].first;
+                live[index] = live.back();
+                live.pop_back();
+            }
+            if ((i & 0xfff) == 0) {
+                peak_reserved = std::max(peak_reserved, arena.reserved_bytes());
+            }
+        }
+    }));
+    peak_reserved = std::max(peak_reserved, arena.reserved_bytes());
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << peak_reserved / (1024.0 * 1024.0) << " MB";
+    std::cout << std::setw(27) << std::setprecision(2) << std::fixed << std::right << live_bytes / (1024.0 * 1024.0) << " MB";
+    std::cout << std::setw(29) << std::setprecision(2) << std::fixed << std::right << static_cast<double>(arena.reserved_bytes()) / std::max<std::size_t>(live_bytes, 1) << "x";
+    std::cout << std::endl;
+
+    for (auto &block : live) {
+        allocator.deallocate(block.second, block.first);
+    }
+}
+
+// The bump arena against the two that reuse freed space, on blocks of up to 1 KiB
+// and up to 64 KiB
+static void testFragmentation() {
+
+    static const std::size_t slab_size = 1024 * 1024;
+
+    for (std::size_t scale : {std::size_t(1), std::size_t(64)}) {
+        std::cout << std::endl << "=====================" << std::endl;
+        std::cout << " Testing fragmentation, 0 - " << scale << " KiB blocks" << std::endl;
+        std::cout << "=====================" << std::endl;
+
+        printHeader({"RandomSizeRandomOrder", "PeakReserved", "Live", "ReservedOverLive"});
+
+        {
+            tf::arena arena(slab_size);
+            runFragmentation("tf::arena", arena, scale);
+        }
+        {
+            tf::tlsf_arena<> arena(slab_size);
+            runFragmentation("tf::tlsf_arena", arena, scale);
+        }
+        {
+            tf::buddy_arena<> arena(slab_size);
+            runFragmentation("tf::buddy_arena", arena, scale);
+        }
+    }
+}
+
+static const std::size_t latency_operations = 2000000;
+
+struct latencies {
+    std::vector<std::uint64_t> m_allocate;
+    std::vector<std::uint64_t> m_deallocate;
+};
+
+// The AllocateDeallocateRandomSize pattern with each allocate and free timed on its
+// own, so the cost of flushing a batch of deferred frees lands in the tail of the
+// free latencies instead of being averaged away
+template <typename Arena> latencies testLatencies(Arena &arena) {
+    latencies result;
+    result.m_allocate.reserve(latency_operations);
+    result.m_deallocate.reserve(latency_operations);
+
+    std::vector<std::pair<std::size_t, typename Arena::pointer>> live;
+    live.reserve(latency_operations);
+
+    for (std::size_t i = 0; i < latency_operations; ++i) {
+        if (add_remove_flags[i] || live.empty()) {
+            const std::size_t size = random_allocation_sizes[i];
+            const std::uint64_t start = tf::tick_clock::now();
+            auto p = arena.allocate(size);
+            result.m_allocate.push_back(tf::tick_clock::now() - start);
+            live.emplace_back(size, p);
+        } else {
+            const std::size_t index = static_cast<std::size_t>(std::rand()) % live.size();
+            const auto block = live[index];
+            live[index] = live.back();
+            live.pop_back();
+            const std::uint64_t start = tf::tick_clock::now();
+            arena.deallocate(block.second, block.first);
+            result.m_deallocate.push_back(tf::tick_clock::now() - start);
+        }
+    }
+
+    for (const auto &block : live) {
+        arena.deallocate(block.second, block.first);
+    }
+    return result;
+}
+
+static void logPercentiles(std::vector<std::uint64_t> &ticks) {
+    std::sort(ticks.begin(), ticks.end());
+    const double total = static_cast<double>(std::accumulate(ticks.begin(), ticks.end(), std::uint64_t(0)));
+    std::cout << std::setw(27) << std::setprecision(1) << std::fixed << std::right << tf::tick_clock::nanoseconds(1) * total / ticks.size() << " ns";
+    for (double q : {0.5, 0.99, 0.999}) {
+        const std::size_t index = std::min(ticks.size() - 1, static_cast<std::size_t>(q * ticks.size()));
+        std::cout << std::setw(27) << tf::tick_clock::nanoseconds(ticks[index]) << " ns";
+    }
+    std::cout << std::setw(27) << tf::tick_clock::nanoseconds(ticks.back()) << " ns";
+}
+
+// Frees handed to tf::arena one at a time, against queued in a deferred_free and
+// handed over in sorted batches: with slabs large enough that the live blocks sit in
+// a few of them, with slabs so small the chain is hundreds long and finding a block's
+// slab is a long walk, and in front of a locked arena. A flush costs a sort of the
+// batch, so deferral only pays for itself where lookups or the lock are expensive.
+static void testDeferred() {
+
+    static const std::size_t slab_size = 1024 * 1024;
+    static const std::size_t small_slab_size = 16 * 1024;
+
+    using locked_arena = tf::linear_arena<tf::fixed_growth, tf::spin_lock>;
+
+    std::vector<std::pair<std::string, latencies>> results;
+    {
+        tf::arena arena(slab_size);
+        results.emplace_back("tf::arena", testLatencies(arena));
+    }
+    {
+        tf::arena arena(slab_size);
+        tf::deferred_free<tf::arena, 64> deferred(arena);
+        results.emplace_back("tf::arena, deferred_free<64>", testLatencies(deferred));
+    }
+    {
+        tf::arena arena(small_slab_size);
+        results.emplace_back("tf::arena, 16 KiB slabs", testLatencies(arena));
+    }
+    {
+        tf::arena arena(small_slab_size);
+        tf::deferred_free<tf::arena, 64> deferred(arena);
+        results.emplace_back("tf::arena, 16 KiB slabs, deferred_free<64>", testLatencies(deferred));
+    }
+    {
+        tf::arena arena(small_slab_size);
+        tf::deferred_free<tf::arena, 512> deferred(arena);
+        results.emplace_back("tf::arena, 16 KiB slabs, deferred_free<512>", testLatencies(deferred));
+    }
+    {
+        locked_arena arena(slab_size);
+        results.emplace_back("tf::arena<spin_lock>", testLatencies(arena));
+    }
+    {
+        locked_arena arena(slab_size);
+        tf::deferred_free<locked_arena, 64> deferred(arena);
+        results.emplace_back("tf::arena<spin_lock>, deferred_free<64>", testLatencies(deferred));
+    }
+
+    const std::pair<const char *, std::vector<std::uint64_t> latencies::*> operations[] = {{"allocate", &latencies::m_allocate}, {"deallocate", &latencies::m_deallocate}};
+    for (const auto &operation : operations) {
+        std::cout << std::endl << "=====================" << std::endl;
+        std::cout << " Testing " << operation.first << " latency" << std::endl;
+        std::cout << "=====================" << std::endl;
+
+        printHeader({"Mean", "p50", "p99", "p99.9", "Max"});
+        for (auto &result : results) {
+            std::cout << std::left << std::setw(60) << result.first;
+            logPercentiles(result.second.*operation.second);
+            std::cout << std::endl;
+        }
+    }
+}
+
+static const std::size_t sweep_rounds = 1000000;
+
+template <typename T> struct type_tag {
+    using type = T;
+};
+
+// calls f with a type_tag of each of Ts in turn
+template <typename... Ts, typename F> void forEachType(F &&f) {
+    const int expand[] = {0, (f(type_tag<Ts>()), 0)...};
+    (void)expand;
+}
+
+static const char *policyName(type_tag<tf::mapped_slabs>) { return "mapped"; }
+static const char *policyName(type_tag<tf::malloc_slabs>) { return "malloc"; }
+static const char *policyName(type_tag<tf::pow2_malloc_slabs>) { return "pow2_malloc"; }
+static const char *policyName(type_tag<tf::fixed_growth>) { return "fixed"; }
+static const char *policyName(type_tag<tf::geometric_growth<>>) { return "geometric"; }
+static const char *policyName(type_tag<tf::chain_lookup>) { return "chain"; }
+static const char *policyName(type_tag<tf::current_slab_lookup>) { return "current_slab"; }
+static const char *policyName(type_tag<tf::null_lock>) { return "null_lock"; }
+static const char *policyName(type_tag<tf::spin_lock>) { return "spin_lock"; }
+static const char *policyName(type_tag<tf::no_stats>) { return "no_stats"; }
+static const char *policyName(type_tag<tf::counting_stats>) { return "counting_stats"; }
+
+struct policy_result {
+    std::string m_name;
+    std::chrono::microseconds m_simple;
+    std::chrono::microseconds m_random_size;
+};
+
+template <typename Arena> policy_result runPolicies(const std::string &name) {
+    static const std::size_t slab_size = 64 * 1024;
+
+    policy_result result{name, std::chrono::microseconds(0), std::chrono::microseconds(0)};
+    {
+        Arena arena(slab_size);
+        tf::linear_allocator<char, Arena> allocator(arena);
+        result.m_simple = tf::measure<std::chrono::microseconds>::execution([&]() { testSimpleAllocateDeallocate(allocator, sweep_rounds * 10); });
+    }
+    {
+        Arena arena(slab_size);
+        tf::linear_allocator<char, Arena> allocator(arena);
+        result.m_random_size = tf::measure<std::chrono::microseconds>::execution([&]() { testAllocateDeallocateRandomSize(allocator, sweep_rounds); });
+    }
+    return result;
+}
+
+// Every combination of basic_arena's policies on the simple and random size
+// workloads, with 64 KiB slabs so lookups have a chain to walk, listed fastest
+// first by the random size time
+static void testPolicies() {
+
+    std::vector<policy_result> results;
+
+    forEachType<tf::mapped_slabs, tf::malloc_slabs, tf::pow2_malloc_slabs>([&](auto source) {
+        forEachType<tf::fixed_growth, tf::geometric_growth<>>([&](auto growth) {
+            forEachType<tf::chain_lookup, tf::current_slab_lookup>([&](auto lookup) {
+                forEachType<tf::null_lock, tf::spin_lock>([&](auto sync) {
+                    forEachType<tf::no_stats, tf::counting_stats>([&](auto stats) {
+                        using arena_type = tf::basic_arena<typename decltype(source)::type, typename decltype(growth)::type, typename decltype(lookup)::type,
+                                                           typename decltype(sync)::type, typename decltype(stats)::type>;
+                        std::ostringstream name;
+                        name << policyName(source) << ", " << policyName(growth) << ", " << policyName(lookup) << ", " << policyName(sync) << ", " << policyName(stats);
+                        results.push_back(runPolicies<arena_type>(name.str()));
+                    });
+                });
+            });
+        });
+    });
+
+    std::sort(results.begin(), results.end(), [](const policy_result &a, const policy_result &b) { return a.m_random_size < b.m_random_size; });
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing basic_arena policy combinations" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocate", "AllocateDeallocateRandomSize"});
+    for (const policy_result &result : results) {
+        std::cout << std::left << std::setw(60) << result.m_name;
+        logTime(result.m_simple);
+        logTime(result.m_random_size);
+        std::cout << std::endl;
+    }
+}
+
+static const std::size_t warm_up_allocations = 16384;
+static const std::size_t warm_up_rounds = 20;
+static const std::size_t warm_up_slab_size = 16 * 1024 * 1024;
+
+// The first allocations a fresh arena hands out, each timed on its own together with
+// filling the block (a bump allocator never touches the memory itself, so the fault
+// lands on the caller's first write), repeated over fresh arenas. Cold, every new page
+// the bump pointer reaches costs a page fault; warmed up, construction has paid for them.
+static void runWarmUp(const char *name, const tf::warm_up *warm) {
+    std::vector<std::uint64_t> ticks;
+    ticks.reserve(warm_up_allocations * warm_up_rounds);
+    std::chrono::microseconds construction(0);
+    std::size_t locked = 0;
+
+    for (std::size_t round = 0; round < warm_up_rounds; ++round) {
+        std::unique_ptr<tf::arena> arena;
+        construction += tf::measure<std::chrono::microseconds>::execution([&]() {
+            arena.reset(warm != nullptr ? new tf::arena(warm_up_slab_size, tf::mapped_slabs::policy(), *warm) : new tf::arena(warm_up_slab_size));
+        });
+        locked = arena->locked_bytes();
+
+        for (std::size_t i = 0; i < warm_up_allocations; ++i) {
+            const std::size_t size = random_allocation_sizes[i];
+            const std::uint64_t start = tf::tick_clock::now();
+            auto p = arena->allocate(size);
+            std::memset(p, 1, size);
+            ticks.push_back(tf::tick_clock::now() - start);
+        }
+    }
+
+    std::cout << std::left << std::setw(60) << name;
+    logTime(construction / warm_up_rounds);
+    logPercentiles(ticks);
+    if (warm != nullptr && warm->m_lock && locked == 0) {
+        std::cout << " (mlock refused)";
+    }
+    std::cout << std::endl;
+}
+
+static void testWarmUp() {
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing first " << warm_up_allocations << " allocations of a fresh arena" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    const tf::warm_up touch(tf::warm_up::touch);
+    const tf::warm_up populate(tf::warm_up::populate);
+    const tf::warm_up locked(tf::warm_up::populate, true);
+
+    printHeader({"Construct", "Mean", "p50", "p99", "p99.9", "Max"});
+    runWarmUp("tf::arena", nullptr);
+    runWarmUp("tf::arena, warm_up(touch)", &touch);
+    runWarmUp("tf::arena, warm_up(populate)", &populate);
+    runWarmUp("tf::arena, warm_up(populate, mlock)", &locked);
+}
+
+static const std::size_t container_elements = 500000;
+
+// keeps traversal and lookup results from being optimised away
+static volatile std::uint64_t container_sink;
+
+// The containers are given an allocator of char and rebind it, so every row can
+// be built from the same arena and allocator pair
+template <typename A, typename T> using rebound = typename std::allocator_traits<A>::template rebind_alloc<T>;
+
+static std::uint64_t container_key(std::size_t i) {
+    return (static_cast<std::uint64_t>(random_allocation_sizes[i % iterations]) << 20) ^ (i * 0x9E3779B1u);
+}
+
+static void logSink(std::uint64_t value) {
+    container_sink = value;
+}
+
+template <typename A> void testList(A &allocator) {
+    using list_type = std::list<std::uint64_t, rebound<A, std::uint64_t>>;
+    std::unique_ptr<list_type> list;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        list.reset(new list_type(rebound<A, std::uint64_t>(allocator)));
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            list->push_back(i);
+        }
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (int pass = 0; pass < 10; ++pass) {
+            for (std::uint64_t v : *list) {
+                sum += v;
+            }
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { list.reset(); }));
+}
+
+template <typename A> void testDeque(A &allocator) {
+    using deque_type = std::deque<std::uint64_t, rebound<A, std::uint64_t>>;
+    std::unique_ptr<deque_type> deque;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        deque.reset(new deque_type(rebound<A, std::uint64_t>(allocator)));
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            if (add_remove_flags[i]) {
+                deque->push_back(i);
+            } else {
+                deque->push_front(i);
+            }
+        }
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (int pass = 0; pass < 10; ++pass) {
+            for (std::uint64_t v : *deque) {
+                sum += v;
+            }
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { deque.reset(); }));
+}
+
+template <typename Map, typename A> void testMap(A &allocator) {
+    std::unique_ptr<Map> map;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        map.reset(new Map(rebound<A, typename Map::value_type>(allocator)));
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            map->emplace(container_key(i), i);
+        }
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (int pass = 0; pass < 10; ++pass) {
+            for (const auto &entry : *map) {
+                sum += entry.second;
+            }
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            sum += map->find(container_key((i * 7919) % container_elements))->second;
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { map.reset(); }));
+}
+
+// A trie over the nibbles of 32 bit keys, each node a separate allocation holding
+// sixteen child pointers, so every lookup chases eight of them
+template <typename A> class nibble_trie {
+    struct node {
+        node *m_children[16];
+        bool m_terminal;
+    };
+
+    using allocator_type = rebound<A, node>;
+
+    allocator_type m_allocator;
+    node *m_root;
+
+    node *make() {
+        node *n = std::allocator_traits<allocator_type>::allocate(m_allocator, 1);
+        std::memset(n->m_children, 0, sizeof(n->m_children));
+        n->m_terminal = false;
+        return n;
+    }
+
+    void destroy(node *n) {
+        for (node *child : n->m_children) {
+            if (child != nullptr) {
+                destroy(child);
+            }
+        }
+        std::allocator_traits<allocator_type>::deallocate(m_allocator, n, 1);
+    }
+
+    std::size_t count(const node *n) const {
+        std::size_t c = n->m_terminal ? 1 : 0;
+        for (const node *child : n->m_children) {
+            if (child != nullptr) {
+                c += count(child);
+            }
+        }
+        return c;
+    }
+
+public:
+    explicit nibble_trie(const A &allocator) : m_allocator(allocator), m_root(make()) {}
+
+    ~nibble_trie() {
+        destroy(m_root);
+    }
+
+    nibble_trie(const nibble_trie &) = delete;
+    nibble_trie &operator=(const nibble_trie &) = delete;
+
+    void insert(std::uint32_t key) {
+        node *n = m_root;
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            node *&child = n->m_children[(key >> shift) & 0xf];
+            if (child == nullptr) {
+                child = make();
+            }
+            n = child;
+        }
+        n->m_terminal = true;
+    }
+
+    bool contains(std::uint32_t key) const {
+        const node *n = m_root;
+        for (int shift = 28; shift >= 0 && n != nullptr; shift -= 4) {
+            n = n->m_children[(key >> shift) & 0xf];
+        }
+        return n != nullptr && n->m_terminal;
+    }
+
+    std::size_t size() const {
+        return count(m_root);
+    }
+};
+
+template <typename A> void testTrie(A &allocator) {
+    std::unique_ptr<nibble_trie<A>> trie;
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        trie.reset(new nibble_trie<A>(allocator));
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            trie->insert(static_cast<std::uint32_t>(container_key(i)));
+        }
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (int pass = 0; pass < 10; ++pass) {
+            sum += trie->size();
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+        std::uint64_t sum = 0;
+        for (std::size_t i = 0; i < container_elements; ++i) {
+            sum += trie->contains(static_cast<std::uint32_t>(container_key((i * 7919) % container_elements)));
+        }
+        logSink(sum);
+    }));
+    logTime(tf::measure<std::chrono::microseconds>::execution([&]() { trie.reset(); }));
+}
+
+template <typename A> struct list_tests {
+    static void run(A &allocator) { testList(allocator); }
+};
+
+template <typename A> struct deque_tests {
+    static void run(A &allocator) { testDeque(allocator); }
+};
+
+template <typename A> struct map_tests {
+    static void run(A &allocator) { testMap<std::map<std::uint64_t, std::uint64_t, std::less<std::uint64_t>, rebound<A, std::pair<const std::uint64_t, std::uint64_t>>>>(allocator); }
+};
+
+template <typename A> struct unordered_map_tests {
+    static void run(A &allocator) { testMap<std::unordered_map<std::uint64_t, std::uint64_t, std::hash<std::uint64_t>, std::equal_to<std::uint64_t>, rebound<A, std::pair<const std::uint64_t, std::uint64_t>>>>(allocator); }
+};
+
+template <typename A> struct trie_tests {
+    static void run(A &allocator) { testTrie(allocator); }
+};
+
+template <typename A, template <typename> class Runner> void runContainer(const char *name, A &allocator) {
+    std::cout << std::left << std::setw(60) << name;
+    Runner<A>::run(allocator);
+    std::cout << std::endl;
+}
+
+template <template <typename> class Runner> void runContainerAllocators() {
+
+    static const std::size_t slab_size = 1024 * 1024;
+
+    {
+        std::allocator<char> allocator;
+        runContainer<std::allocator<char>, Runner>("std::allocator", allocator);
+    }
+    {
+        tf::arena arena(slab_size);
+        tf::linear_allocator<char> allocator(arena);
+        runContainer<tf::linear_allocator<char>, Runner>("tf::arena", allocator);
+    }
+    {
+        tf::arena_unoptimised arena(slab_size);
+        tf::linear_allocator<char, tf::arena_unoptimised> allocator(arena);
+        runContainer<tf::linear_allocator<char, tf::arena_unoptimised>, Runner>("tf::arena_unoptimised", allocator);
+    }
+    {
+        tf::new_arena<slab_size> arena;
+        tf::linear_allocator<char, tf::new_arena<slab_size>> allocator(arena);
+        runContainer<tf::linear_allocator<char, tf::new_arena<slab_size>>, Runner>("tf::new_arena", allocator);
+    }
+    {
+        tf::epoch_arena arena(slab_size);
+        tf::linear_allocator<char, tf::epoch_arena> allocator(arena);
+        runContainer<tf::linear_allocator<char, tf::epoch_arena>, Runner>("tf::epoch_arena", allocator);
+    }
+    {
+        tf::tlsf_arena<> arena(slab_size);
+        tf::linear_allocator<char, tf::tlsf_arena<>> allocator(arena);
+        runContainer<tf::linear_allocator<char, tf::tlsf_arena<>>, Runner>("tf::tlsf_arena", allocator);
+    }
+    {
+        tf::buddy_arena<> arena(slab_size);
+        tf::linear_allocator<char, tf::buddy_arena<>> allocator(arena);
+        runContainer<tf::linear_allocator<char, tf::buddy_arena<>>, Runner>("tf::buddy_arena", allocator);
+    }
+    {
+        short_alloc<char, 4096>::arena_type arena;
+        short_alloc<char, 4096> allocator(arena);
+        runContainer<short_alloc<char, 4096>, Runner>("short_alloc", allocator);
+    }
+}
+
+// Node based containers built through each allocator and then walked, so that
+// where the allocator puts the nodes shows up in the traversal and lookup times as
+// well as in the cost of building them. Traversals are ten passes.
+static void testContainers() {
+
+    const std::pair<const char *, void (*)()> containers[] = {
+        {"std::list", &runContainerAllocators<list_tests>},
+        {"std::deque", &runContainerAllocators<deque_tests>},
+        {"std::map", &runContainerAllocators<map_tests>},
+        {"std::unordered_map", &runContainerAllocators<unordered_map_tests>},
+        {"nibble trie", &runContainerAllocators<trie_tests>},
+    };
+
+    for (const auto &container : containers) {
+        const bool lookups = std::strcmp(container.first, "std::list") != 0 && std::strcmp(container.first, "std::deque") != 0;
+
+        std::cout << std::endl << "=====================" << std::endl;
+        std::cout << " Testing " << container.first << " x " << container_elements << std::endl;
+        std::cout << "=====================" << std::endl;
+
+        if (lookups) {
+            printHeader({"Build", "Traverse", "Lookup", "Destroy"});
+        } else {
+            printHeader({"Build", "Traverse", "Destroy"});
+        }
+        container.second();
+    }
+}
+
+static const std::size_t persistent_entries = 1000000;
+static const std::size_t persistent_lookups = 1000000;
+
+// keeps the lookups from being optimised away
+static volatile std::uint64_t lookup_sink;
+
+template <typename Lookup> static std::uint64_t testLookups(const std::vector<std::uint64_t> &keys, Lookup lookup) {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < persistent_lookups; ++i) {
+        sum += lookup(keys[i % keys.size()]);
+    }
+    return sum;
+}
+
+// Building a large map against picking it up again on restart. A std::map has to
+// be rebuilt every time (here from an in-memory copy of its contents, the best a
+// deserialiser could do), an offset_map in a persistent_arena is just remapped.
+static void testPersistent() {
+
+    using map_type = tf::offset_map<std::uint64_t, std::uint64_t, tf::persistent_allocator<char>>;
+
+    static const std::size_t capacity = 1024 * 1024 * 1024;
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing persistent reattach" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"Build", "Reattach", "Lookup"});
+
+    std::vector<std::uint64_t> keys(persistent_entries);
+    for (std::uint64_t &key : keys) {
+        key = (static_cast<std::uint64_t>(std::rand()) << 32) ^ static_cast<std::uint64_t>(std::rand());
+    }
+
+    {
+        std::uint64_t sum = 0;
+        std::cout << std::left << std::setw(60) << "std::map";
+        std::map<std::uint64_t, std::uint64_t> built;
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                built[keys[i]] = i;
+            }
+        }));
+        const std::vector<std::pair<std::uint64_t, std::uint64_t>> contents(built.begin(), built.end());
+        built.clear();
+        std::map<std::uint64_t, std::uint64_t> reloaded;
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            reloaded.insert(contents.begin(), contents.end());
+        }));
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            sum = testLookups(keys, [&](std::uint64_t key) { return reloaded.find(key)->second; });
+        }));
+        std::cout << std::endl;
+        lookup_sink = sum;
+    }
+
+    {
+        const char *tmpdir = std::getenv("TMPDIR");
+        const std::string path = std::string(tmpdir != nullptr ? tmpdir : "/tmp") + "/alloctor_tests_persistent_" + std::to_string(::getpid()) + ".arena";
+        std::uint64_t sum = 0;
+        std::cout << std::left << std::setw(60) << "tf::offset_map + tf::persistent_arena";
+        logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+            tf::persistent_arena arena(path, capacity);
+            tf::persistent_allocator<char> allocator(arena);
+            map_type *map = new (arena.allocate(sizeof(map_type))) map_type();
+            arena.set_root(map);
+            for (std::size_t i = 0; i < keys.size(); ++i) {
+                map->insert(allocator, keys[i], i);
+            }
+        }));
+        {
+            std::unique_ptr<tf::persistent_arena> arena;
+            map_type *map = nullptr;
+            logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+                arena.reset(new tf::persistent_arena(path, capacity));
+                map = arena->root<map_type>();
+            }));
+            logTime(tf::measure<std::chrono::microseconds>::execution([&]() {
+                sum = testLookups(keys, [&](std::uint64_t key) { return *map->find(key); });
+            }));
+        }
+        ::unlink(path.c_str());
+        std::cout << std::endl;
+        lookup_sink = sum;
+    }
+}
+
+// The candidates the registry section compares and the arena each type is routed to.
+// Set ARENA_CONFIG to a file in the same format, see arena_registry.h, to try another
+// choice without rebuilding.
+static const char *default_arena_config =
+    "arena linear arena 1048576\n"
+    "arena tlsf tlsf 1048576\n"
+    "arena buddy buddy 1048576\n"
+    "type char linear\n"
+    "type uint32_t linear\n"
+    "type uint64_t linear\n"
+    "type double linear\n"
+    "type small_obj tlsf\n"
+    "type large_obj linear\n";
+
+static std::string arenaConfig() {
+    const char *path = std::getenv("ARENA_CONFIG");
+    if (path == nullptr) {
+        return default_arena_config;
+    }
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error(std::string("cannot read ARENA_CONFIG file ") + path);
+    }
+    std::ostringstream config;
+    config << file.rdbuf();
+    return config.str();
+}
+
+// Every arena in the configuration pinned in turn, then an allocator made for the
+// type's tag, which goes wherever the configuration routes it. Each row gets a fresh
+// registry, so one candidate's fragmentation doesn't carry over to the next.
+template <typename T> void testRegistry(const char *type, const std::string &config) {
+
+    std::cout << std::endl << "=====================" << std::endl;
+    std::cout << " Testing registry candidates for " << type << " (" << sizeof(T) << ")" << std::endl;
+    std::cout << "=====================" << std::endl;
+
+    printHeader({"AllocateDeallocate", "RandomAllocationDeallocate", "AllocateDeallocateRandomSize"});
+
+    std::vector<std::string> names;
+    {
+        tf::arena_registry<> registry(config);
+        for (const auto *slot : registry.slots()) {
+            names.push_back(slot->name());
+        }
+    }
+
+    for (const std::string &name : names) {
+        tf::arena_registry<> registry(config);
+        tf::registry_allocator<T> allocator(registry, *registry.find(name));
+        runTests(name, allocator);
+    }
+
+    tf::arena_registry<> registry(config);
+    tf::registry_allocator<T> allocator(registry, type);
+    runTests(std::string("routed to ") + (allocator.arena_slot() != nullptr ? allocator.arena_slot()->name() : "arenas by size"), allocator);
+}
+
+#define TEST(x) testForType<x>(#x)
+#define TEST_REGISTRY(x) testRegistry<x>(#x, config)
+#define TEST_ZEROED(x) testZeroed<x>(#x)
+
+// With no arguments every benchmark section runs, otherwise only the named ones
+int main(int argc, char *argv[]) {
+
+    initialise();
+
+    const std::set<std::string> sections(argv + 1, argv + argc);
+    auto enabled = [&](const char *section) { return sections.empty() || sections.count(section) != 0; };
+
+    struct small_obj {
+        char data[200];
+        int a;
+        bool b;
+        float c;
+    };
+
+    struct large_obj {
+        char data[3456];
+        int data2[1234];
+    };
+
+    if (enabled("types")) {
+        TEST(char);
+        TEST(uint32_t);
+        TEST(uint64_t);
+        TEST(double);
+        TEST(small_obj);
+        TEST(large_obj);
+    }
+
+    if (enabled("registry")) {
+        const std::string config = arenaConfig();
+        TEST_REGISTRY(char);
+        TEST_REGISTRY(uint32_t);
+        TEST_REGISTRY(uint64_t);
+        TEST_REGISTRY(double);
+        TEST_REGISTRY(small_obj);
+        TEST_REGISTRY(large_obj);
+    }
+
+    if (enabled("zeroed")) {
+        TEST_ZEROED(uint64_t);
+        TEST_ZEROED(large_obj);
+    }
+
+    if (enabled("containers")) {
+        testContainers();
+    }
+
+    if (enabled("generational")) {
+        testGenerational();
+    }
+
+    if (enabled("threads")) {
+        testThreads();
+    }
+
+    if (enabled("cache")) {
+        testCache();
+    }
+
+    if (enabled("strings")) {
+        testStrings();
+    }
+
+    if (enabled("commit")) {
+        testCommit();
+    }
+
+    if (enabled("growth")) {
+        testGrowthPolicies();
+    }
+
+    if (enabled("contention")) {
+        testContention();
+    }
+
+    if (enabled("profiler")) {
+        testProfiler();
+    }
+
+    if (enabled("fragmentation")) {
+        testFragmentation();
+    }
+
+    if (enabled("deferred")) {
+        testDeferred();
+    }
+
+    if (enabled("policies")) {
+        testPolicies();
+    }
+
+    if (enabled("warmup")) {
+        testWarmUp();
+    }
+
+    if (enabled("persistent")) {
+        testPersistent();
+    }
 
     return 0;
 }
@@ -26,14 +26,27 @@
 #ifndef FASTPATH_FAST_NEW_ARENA_H
 #define FASTPATH_FAST_NEW_ARENA_H
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
+#include <functional>
+#include <new>
+#include <ostream>
 #include <atomic>
+#include "allocation_profiler.h"
 #include "optimize.h"
+#include "slab_exchange.h"
+#include "slab_growth.h"
+#include "slab_memory.h"
+#include "zero_fill.h"
 
 namespace tf {
 
-    template<std::size_t S = 1024>
+    // Exchange decides whether empty slabs are shared between threads, see slab_exchange.h,
+    // and Growth the size of each new slab, see slab_growth.h
+    template<std::size_t S = 1024, typename Exchange = no_slab_exchange, typename Growth = fixed_growth>
     class new_arena {
     public:
         using value_type = unsigned char;
@@ -41,43 +54,75 @@ namespace tf {
         static constexpr std::size_t initial_size = S;
 
     private:
-        struct alignas(16) slab {
-            pointer m_content;
+        // The header is one cache line at the front of the slab's own memory, as slabs
+        // move between threads and cannot live in an arena-owned array like tf::arena's.
+        // Nothing handed out can share that line, so the header's atomics never falsely
+        // share with user data being written by whichever thread owns it.
+        struct alignas(64) slab {
             std::atomic<pointer> m_head;
-            std::atomic<slab *> m_next;
-            std::size_t m_size;
             std::atomic<std::size_t> m_allocated;
+            pointer m_content;
+            std::size_t m_size;
+            std::atomic<slab *> m_next;
+            // end of the pages the bump pointer may have touched, see slab_memory.h
+            pointer m_dirty;
+            // everything from here (or from m_head, if that is higher) up is still zero:
+            // the whole of a slab fresh from mmap, none of one from malloc
+            pointer m_clean;
+            bool m_mapped;
 
+            // zero byte blocks still take one unit, so each is a distinct address inside its slab
             static inline std::size_t align_up(std::size_t n) noexcept {
-                static const size_t alignment = 16 - 1;
-                return (n + (alignment)) & ~(alignment);
+                static const size_t alignment = 16;
+                return (std::max<std::size_t>(n, 1) + (alignment-1)) & ~(alignment-1);
             }
 
             inline bool pointer_in_buffer(pointer p) const noexcept {
-                return m_content <= p && p <= m_head;
-            }
-
-            slab(std::size_t size) noexcept : m_next(nullptr), m_allocated(0) {
-                // this will find the next x^2 number larger than the one provided
-                m_size = size;
-                m_size--;
-                m_size |= m_size >> 1;
-                m_size |= m_size >> 2;
-                m_size |= m_size >> 4;
-                m_size |= m_size >> 8;
-                m_size |= m_size >> 16;
-                m_size++;
-
-//                m_content = std::allocator_traits<allocator_type>::allocate(m_allocator, m_size);
-//                m_content = new value_type[size];
-                m_content = static_cast<pointer>(::malloc(m_size));
+                return m_content <= p && p < m_content + m_size;
+            }
+
+            slab(std::size_t size, bool mapped) noexcept : m_allocated(0), m_content(reinterpret_cast<pointer>(this + 1)), m_size(size), m_next(nullptr), m_mapped(mapped) {
                 m_head = m_content;
+                m_dirty = m_content;
+                m_clean = mapped ? m_content : m_content + m_size;
+            }
+
+            // the header and its content in one cache line aligned block
+            static slab *create(std::size_t size) {
+                size = round_up_pow2(size);
+
+                bool mapped;
+                void *p = slab_memory::allocate(sizeof(slab) + size, alignof(slab), s_policy, mapped);
+                return new (p) slab(size, mapped);
+            }
+
+            static void destroy(slab *s) noexcept {
+                const std::size_t size = sizeof(slab) + s->m_size;
+                const bool mapped = s->m_mapped;
+                s->~slab();
+                slab_memory::deallocate(s, size, mapped);
             }
 
-            ~slab() noexcept {
-//                std::allocator_traits<allocator_type>::deallocate(m_allocator, m_content, m_size);
-//                delete [] m_content;
-                ::free(m_content);
+            inline void lower_head(pointer head) noexcept {
+                const pointer h = m_head.load(std::memory_order_relaxed);
+                if (h > m_dirty) {
+                    m_dirty = h;
+                }
+                if (h > m_clean) {
+                    m_clean = h;
+                }
+                m_head = head;
+            }
+
+            // hand back pages well above the bump pointer once it has fallen back
+            inline void trim() noexcept {
+                if (unlikely(m_mapped)) {
+                    const pointer dirty = slab_memory::trim(m_head.load(std::memory_order_relaxed), m_dirty, s_policy);
+                    if (dirty != m_dirty && slab_memory::releases_zeroed(s_policy) && slab_memory::page_up(m_dirty) >= m_clean) {
+                        m_clean = dirty;
+                    }
+                    m_dirty = dirty;
+                }
             }
 
             inline std::size_t free() const noexcept {
@@ -93,20 +138,129 @@ namespace tf {
                 return p;
             }
 
+            // as allocate, also counting how many of the block's first 'size' bytes may not be zero
+            inline pointer allocate_clean(std::size_t size, std::size_t &dirty) noexcept {
+                pointer p = allocate(size);
+                dirty = m_clean > p ? std::min(static_cast<std::size_t>(m_clean - p), size) : 0;
+                return p;
+            }
+
             inline void deallocate(pointer ptr, std::size_t size) noexcept {
                 assert(pointer_in_buffer(ptr));
                 size = align_up(size);
-                m_allocated.fetch_sub(size, std::memory_order_acq_rel);
                 if ((m_allocated -= size) == 0) {
-                    m_head = m_content;
+                    lower_head(m_content);
                 } else if (ptr + size == m_head) {
-                    m_head = ptr;
+                    lower_head(ptr);
+                }
+            }
+
+            template <typename P> inline void allocate_n(std::size_t size, std::size_t count, P *out) noexcept {
+                size = align_up(size);
+                assert(this->free() >= size * count);
+                pointer p = m_head.fetch_add(size * count);
+                for (std::size_t i = 0; i < count; ++i) {
+                    out[i] = reinterpret_cast<P>(p);
+                    p += size;
                 }
+                m_allocated.fetch_add(size * count);
+            }
+
+            // release a run of blocks totalling 'size' (already aligned) bytes, the lowest of which is at 'lowest'
+            inline void deallocate_run(pointer lowest, std::size_t size) noexcept {
+                assert(pointer_in_buffer(lowest));
+                if ((m_allocated -= size) == 0) {
+                    lower_head(m_content);
+                } else if (lowest + size == m_head) {
+                    lower_head(lowest);
+                }
+            }
+
+            // grow or shrink the block at 'ptr' without moving it, sizes are already aligned
+            inline bool try_expand(pointer ptr, std::size_t old_size, std::size_t new_size) noexcept {
+                assert(pointer_in_buffer(ptr));
+                if (ptr + old_size == m_head) {
+                    if (new_size > old_size && static_cast<std::size_t>(m_content + m_size - ptr) < new_size) {
+                        return false;
+                    }
+                    lower_head(ptr + new_size);
+                } else if (new_size > old_size) {
+                    return false;
+                }
+                m_allocated = m_allocated - old_size + new_size;
+                return true;
             }
         };
 
+        static_assert(sizeof(slab) == 64, "the slab header should fill exactly one cache line");
+
         static __thread slab *s_root_slab;
         static __thread slab *s_current_slab;
+        static __thread Growth s_growth;
+
+        // written by every thread that gets a new slab, so kept on a line of their own
+        struct alignas(64) slab_stats {
+            std::atomic<std::size_t> m_slab_mallocs;
+            std::atomic<std::size_t> m_reserved_bytes;
+            std::atomic<std::size_t> m_peak_reserved_bytes;
+        };
+
+        static Exchange s_exchange;
+        static slab_stats s_stats;
+        static commit_policy s_policy;
+
+        // a fresh slab, taken from another thread's spares when the exchange has one
+        // the size of a new slab for an allocation of 'size' bytes that no existing slab has room for
+        static std::size_t grow_size(std::size_t size) noexcept {
+            std::size_t live = 0;
+            if (Growth::tracks_demand) {
+                for (const slab *s = s_root_slab; s != nullptr; s = s->m_next) {
+                    live += s->m_allocated;
+                }
+            }
+            return s_growth.next_size(size, initial_size, live);
+        }
+
+        static slab *new_slab(std::size_t size) {
+            if (Exchange::enabled) {
+                if (slab *s = static_cast<slab *>(s_exchange.take(size))) {
+                    s->lower_head(s->m_content);
+                    s->m_next = nullptr;
+                    return s;
+                }
+            }
+
+            slab *s = slab::create(size);
+            s_stats.m_slab_mallocs.fetch_add(1, std::memory_order_relaxed);
+            const std::size_t reserved = s_stats.m_reserved_bytes.fetch_add(s->m_size, std::memory_order_relaxed) + s->m_size;
+            std::size_t peak = s_stats.m_peak_reserved_bytes.load(std::memory_order_relaxed);
+            while (reserved > peak && !s_stats.m_peak_reserved_bytes.compare_exchange_weak(peak, reserved, std::memory_order_relaxed)) {
+            }
+            return s;
+        }
+
+        static void delete_slab(slab *s) noexcept {
+            s_stats.m_reserved_bytes.fetch_sub(s->m_size, std::memory_order_relaxed);
+            slab::destroy(s);
+        }
+
+        // hand a slab that has just become empty to the exchange for other threads to use
+        static void release_if_empty(slab *s) noexcept {
+            if (!Exchange::enabled || s->m_allocated != 0 || s == s_current_slab || s == s_root_slab) {
+                return;
+            }
+
+            slab *prev = s_root_slab;
+            while (prev->m_next != s) {
+                prev = prev->m_next;
+            }
+            prev->m_next = s->m_next.load();
+
+            // the exchange is full, so keep it for ourselves
+            if (!s_exchange.publish(s, s->m_size)) {
+                prev->m_next = s;
+            }
+        }
 
         inline slab *find_slab_with_space(slab *start, std::size_t size) const noexcept {
             if (likely(start->free() >= size)) {
@@ -128,19 +282,41 @@ namespace tf {
             return nullptr;
         }
 
+        // the first slab with room for 'size' (already aligned) bytes, growing the chain if none has
+        slab *slab_with_space(std::size_t size) {
+            slab *s = nullptr;
+            if (likely(s_current_slab->free() >= size)) {
+                return s_current_slab;
+            } else {
+                if ((s = find_slab_with_space(s_root_slab, size)) != nullptr) {
+                    return s;
+                } else {
+                    s = new_slab(grow_size(size));
+                    s->m_next = s_current_slab->m_next.load();
+                    s_current_slab->m_next = s;
+                    s_current_slab = s;
+                    return s_current_slab;
+                }
+            }
+        }
+
     public:
         ~new_arena() {
             slab *s = s_root_slab;
             while (s != nullptr) {
-                s = s->m_next;
-                delete s;
+                slab *next = s->m_next;
+                if (!Exchange::enabled || s->m_allocated != 0 || !s_exchange.publish(s, s->m_size)) {
+                    delete_slab(s);
+                }
+                s = next;
             }
             s_root_slab = nullptr;
+            s_current_slab = nullptr;
         }
 
         new_arena() noexcept {
             if (s_root_slab == nullptr) {
-                s_root_slab = new slab(initial_size);
+                s_root_slab = new_slab(initial_size);
                 s_current_slab = s_root_slab;
             }
         }
@@ -149,32 +325,131 @@ namespace tf {
         new_arena &operator=(const new_arena &) = delete;
 
         new_arena::pointer allocate(std::size_t size) {
-            slab *s = nullptr;
-            if (likely(s_current_slab->free() >= size)) {
-                return s_current_slab->allocate(size);
-            } else {
-                if ((s = find_slab_with_space(s_root_slab, size)) != nullptr) {
-                    return s->allocate(size);
-                } else {
-                    s_current_slab->m_next = new slab(std::max(size, initial_size));
-                    s_current_slab = s_current_slab->m_next;
-                    return s_current_slab->allocate(size);
-                }
+            pointer p = slab_with_space(slab::align_up(size))->allocate(size);
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // a block of 'size' bytes, all zero, which only needs clearing as far as the slab has been used before
+        new_arena::pointer allocate_zeroed(std::size_t size) {
+            std::size_t dirty;
+            pointer p = slab_with_space(slab::align_up(size))->allocate_clean(size, dirty);
+            if (dirty != 0) {
+                zero_fill(p, dirty);
             }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // the same as allocate, the arenas never initialise what they hand out; for
+        // call sites to say that they will overwrite the whole block themselves
+        new_arena::pointer allocate_uninit(std::size_t size) {
+            return allocate(size);
         }
 
         void deallocate(new_arena::pointer p, std::size_t size) noexcept {
+            allocation_profiler::deallocated(p);
             if (s_current_slab->pointer_in_buffer(p)) {
                 s_current_slab->deallocate(p, size);
+                s_current_slab->trim();
             } else {
                 slab *s = find_slab_containing(s_root_slab, p);
                 assert(s != nullptr);
                 if (s != nullptr) {
                     s->deallocate(p, size);
+                    s->trim();
+                    release_if_empty(s);
                 }
             }
         }
 
+        // fill 'out' with 'count' blocks of 'size' bytes, all carved from a single slab reservation
+        template <typename P> void allocate_n(std::size_t size, std::size_t count, P *out) {
+            slab_with_space(slab::align_up(size) * count)->allocate_n(size, count, out);
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::allocated(this, out[i], size);
+            }
+        }
+
+        // release 'count' blocks of 'size' bytes, updating each slab once per run of pointers it contains
+        template <typename P> void deallocate_n(const P *ptrs, std::size_t size, std::size_t count) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::deallocated(ptrs[i]);
+            }
+            size = slab::align_up(size);
+            slab *s = nullptr;
+            pointer lowest = nullptr;
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                pointer p = reinterpret_cast<pointer>(ptrs[i]);
+                if (s == nullptr || !s->pointer_in_buffer(p)) {
+                    if (s != nullptr) {
+                        s->deallocate_run(lowest, run);
+                        s->trim();
+                        release_if_empty(s);
+                    }
+                    s = s_current_slab->pointer_in_buffer(p) ? s_current_slab : find_slab_containing(s_root_slab, p);
+                    assert(s != nullptr);
+                    lowest = p;
+                    run = 0;
+                }
+                lowest = std::min(lowest, p);
+                run += size;
+            }
+            if (s != nullptr) {
+                s->deallocate_run(lowest, run);
+                s->trim();
+                release_if_empty(s);
+            }
+        }
+
+        bool try_expand(new_arena::pointer p, std::size_t old_size, std::size_t new_size) noexcept {
+            slab *s = s_current_slab->pointer_in_buffer(p) ? s_current_slab : find_slab_containing(s_root_slab, p);
+            assert(s != nullptr);
+            if (s != nullptr && s->try_expand(p, slab::align_up(old_size), slab::align_up(new_size))) {
+                s->trim();
+                return true;
+            }
+            return false;
+        }
+
+        // resize in place when the block is the last in its slab, otherwise move it
+        new_arena::pointer reallocate(new_arena::pointer p, std::size_t old_size, std::size_t new_size) {
+            if (try_expand(p, old_size, new_size)) {
+                return p;
+            }
+            pointer n = allocate(new_size);
+            std::memcpy(n, p, std::min(old_size, new_size));
+            deallocate(p, old_size);
+            return n;
+        }
+
+        // bytes in blocks handed out from the calling thread's slabs, after rounding up to the arena's alignment
+        std::size_t used_bytes() const noexcept {
+            std::size_t bytes = 0;
+            for (const slab *s = s_root_slab; s != nullptr; s = s->m_next) {
+                bytes += s->m_allocated;
+            }
+            return bytes;
+        }
+
+        // slabs obtained from malloc by every thread using this arena type
+        static std::size_t slab_mallocs() noexcept { return s_stats.m_slab_mallocs.load(std::memory_order_relaxed); }
+
+        // bytes held in slabs by every thread, including spares waiting in the exchange
+        static std::size_t reserved_bytes() noexcept { return s_stats.m_reserved_bytes.load(std::memory_order_relaxed); }
+        static std::size_t peak_reserved_bytes() noexcept { return s_stats.m_peak_reserved_bytes.load(std::memory_order_relaxed); }
+
+        static void reset_peak() noexcept { s_stats.m_peak_reserved_bytes.store(reserved_bytes(), std::memory_order_relaxed); }
+
+        // how slabs created from now on, by every thread using this arena type, commit and release their pages
+        static void set_commit_policy(const commit_policy &policy) noexcept { s_policy = policy; }
+
+        // free the spare slabs parked in the exchange
+        static void trim() noexcept {
+            s_exchange.drain([](void *s) { delete_slab(static_cast<slab *>(s)); });
+        }
+
         friend std::ostream &operator<<(std::ostream &out, const new_arena &a) {
             std::size_t block_count = 0;
             std::size_t total_free = 0;
@@ -198,9 +473,13 @@ namespace tf {
         }
     };
 
-    template<std::size_t S> __thread typename new_arena<S>::slab *new_arena<S>::s_root_slab = nullptr;
-    template<std::size_t S> __thread typename new_arena<S>::slab *new_arena<S>::s_current_slab = nullptr;
-    template<std::size_t S> constexpr std::size_t new_arena<S>::initial_size;
+    template<std::size_t S, typename E, typename G> __thread typename new_arena<S, E, G>::slab *new_arena<S, E, G>::s_root_slab = nullptr;
+    template<std::size_t S, typename E, typename G> __thread typename new_arena<S, E, G>::slab *new_arena<S, E, G>::s_current_slab = nullptr;
+    template<std::size_t S, typename E, typename G> E new_arena<S, E, G>::s_exchange;
+    template<std::size_t S, typename E, typename G> typename new_arena<S, E, G>::slab_stats new_arena<S, E, G>::s_stats{{0}, {0}, {0}};
+    template<std::size_t S, typename E, typename G> __thread G new_arena<S, E, G>::s_growth;
+    template<std::size_t S, typename E, typename G> commit_policy new_arena<S, E, G>::s_policy;
+    template<std::size_t S, typename E, typename G> constexpr std::size_t new_arena<S, E, G>::initial_size;
 }
 #endif //FASTPATH_FAST_LINEAR_ALLOCATORe_H
 
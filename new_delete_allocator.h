@@ -5,9 +5,93 @@
 #ifndef ALLOCTORTESTS_NEW_DELETE_ALLOCATOR_H
 #define ALLOCTORTESTS_NEW_DELETE_ALLOCATOR_H
 
+#include <algorithm>
 #include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <malloc.h>
 
-template <typename T> class new_delete_allocator {
+// How new_delete_allocator obtains and releases its memory
+namespace new_delete_mode {
+
+    // new T[n] / delete[] p, which constructs and destroys every element and carries an array cookie
+    struct array {
+        template <typename T> static T *allocate(std::size_t size) {
+            return new T[size];
+        }
+
+        template <typename T> static void deallocate(T *p, std::size_t) noexcept {
+            delete [] p;
+        }
+    };
+
+    // raw storage from ::operator new, released without a size
+    struct raw {
+        template <typename T> static T *allocate(std::size_t size) {
+            return static_cast<T *>(::operator new(size * sizeof(T)));
+        }
+
+        template <typename T> static void deallocate(T *p, std::size_t) noexcept {
+            ::operator delete(p);
+        }
+    };
+
+    // raw storage released with C++14 sized delete, so the allocator need not look the size up
+    struct sized {
+        template <typename T> static T *allocate(std::size_t size) {
+            return static_cast<T *>(::operator new(size * sizeof(T)));
+        }
+
+        template <typename T> static void deallocate(T *p, std::size_t size) noexcept {
+            ::operator delete(p, size * sizeof(T));
+        }
+    };
+
+    // raw storage aligned to alignof(T), through the C++17 aligned operators when available
+    struct aligned {
+        template <typename T> static T *allocate(std::size_t size) {
+#if defined(__cpp_aligned_new)
+            return static_cast<T *>(::operator new(size * sizeof(T), std::align_val_t(alignof(T))));
+#else
+            void *p = nullptr;
+            if (::posix_memalign(&p, std::max(alignof(T), sizeof(void *)), size * sizeof(T)) != 0) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T *>(p);
+#endif
+        }
+
+        template <typename T> static void deallocate(T *p, std::size_t size) noexcept {
+#if defined(__cpp_aligned_new)
+            ::operator delete(p, size * sizeof(T), std::align_val_t(alignof(T)));
+#else
+            (void)size;
+            ::free(p);
+#endif
+        }
+    };
+
+    // malloc/free, with malloc_usable_size reporting the real capacity of each block
+    struct usable_size {
+        template <typename T> static T *allocate(std::size_t size) {
+            void *p = ::malloc(size * sizeof(T));
+            if (p == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T *>(p);
+        }
+
+        template <typename T> static std::size_t capacity(T *p) noexcept {
+            return ::malloc_usable_size(p) / sizeof(T);
+        }
+
+        template <typename T> static void deallocate(T *p, std::size_t) noexcept {
+            ::free(p);
+        }
+    };
+}
+
+template <typename T, typename Mode = new_delete_mode::array> class new_delete_allocator {
 public:
     typedef T value_type;
     typedef value_type* pointer;
@@ -17,26 +101,44 @@ public:
     typedef std::size_t size_type;
     typedef std::ptrdiff_t difference_type;
 
+    using mode_type = Mode;
+
+    // the block handed back by allocate_at_least, as in C++23's std::allocation_result
+    struct allocation_result {
+        pointer ptr;
+        size_type count;
+    };
+
 private:
 
     typedef char* storage_type;
 
 public:
     template<typename U> struct rebind {
-        typedef new_delete_allocator<U> other;
+        typedef new_delete_allocator<U, Mode> other;
     };
 
+    new_delete_allocator() noexcept {}
+
+    template <typename U> new_delete_allocator(const new_delete_allocator<U, Mode> &) noexcept {}
+
     inline pointer allocate(const std::size_t size) noexcept {
-        return new T[size];
+        return Mode::template allocate<T>(size);
     }
 
     inline void deallocate(T* p, std::size_t size) noexcept {
-        delete [] p;
+        Mode::template deallocate<T>(p, size);
+    }
+
+    // only available in new_delete_mode::usable_size, reports the slack the system allocator rounded up to
+    template <typename M = Mode> inline auto allocate_at_least(const std::size_t size) noexcept -> decltype(M::template capacity<T>(pointer()), allocation_result()) {
+        pointer p = M::template allocate<T>(size);
+        return {p, M::template capacity<T>(p)};
     }
 };
 
-template <class T, class U> bool operator==(const new_delete_allocator<T>&, const new_delete_allocator<U>&);
-template <class T, class U> bool operator!=(const new_delete_allocator<T>&, const new_delete_allocator<U>&);
+template <class T, class U, class M> bool operator==(const new_delete_allocator<T, M>&, const new_delete_allocator<U, M>&);
+template <class T, class U, class M> bool operator!=(const new_delete_allocator<T, M>&, const new_delete_allocator<U, M>&);
 
 
 #endif //ALLOCTORTESTS_NEW_DELETE_ALLOCATOR_H
@@ -0,0 +1,177 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_OFFSET_MAP_H
+#define FASTPATH_OFFSET_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+
+namespace tf {
+
+    // An ordered map (a treap) linked entirely through its allocator's pointer
+    // type. With tf::persistent_allocator the whole map, including this object,
+    // can live in a persistent_arena and be picked up again after a restart.
+    //
+    // The map does not keep its allocator, since a persistent map must not hold
+    // process-local addresses; it is passed to each modifying call instead.
+    template <typename K, typename V, typename Allocator, typename Compare = std::less<K>> class offset_map {
+        struct node;
+        using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<node>;
+        using node_traits = std::allocator_traits<node_allocator>;
+        using node_pointer = typename node_traits::pointer;
+
+        struct node {
+            K m_key;
+            V m_value;
+            std::uint32_t m_priority;
+            node_pointer m_left;
+            node_pointer m_right;
+
+            node(const K &key, const V &value, std::uint32_t priority) : m_key(key), m_value(value), m_priority(priority), m_left(nullptr), m_right(nullptr) {}
+        };
+
+        node_pointer m_root;
+        std::size_t m_size;
+        std::uint32_t m_seed;
+
+        inline std::uint32_t next_priority() noexcept {
+            // xorshift32, kept in the map so priorities continue after a reattach
+            m_seed ^= m_seed << 13;
+            m_seed ^= m_seed >> 17;
+            m_seed ^= m_seed << 5;
+            return m_seed;
+        }
+
+        static void rotate_right(node_pointer &n) noexcept {
+            node_pointer l = n->m_left;
+            n->m_left = l->m_right;
+            l->m_right = n;
+            n = l;
+        }
+
+        static void rotate_left(node_pointer &n) noexcept {
+            node_pointer r = n->m_right;
+            n->m_right = r->m_left;
+            r->m_left = n;
+            n = r;
+        }
+
+        bool insert(node_allocator &allocator, node_pointer &n, const K &key, const V &value) {
+            if (!n) {
+                node_pointer p = node_traits::allocate(allocator, 1);
+                node_traits::construct(allocator, std::addressof(*p), key, value, next_priority());
+                n = p;
+                return true;
+            }
+
+            Compare less;
+            bool inserted;
+            if (less(key, n->m_key)) {
+                inserted = insert(allocator, n->m_left, key, value);
+                if (n->m_left->m_priority > n->m_priority) {
+                    rotate_right(n);
+                }
+            } else if (less(n->m_key, key)) {
+                inserted = insert(allocator, n->m_right, key, value);
+                if (n->m_right->m_priority > n->m_priority) {
+                    rotate_left(n);
+                }
+            } else {
+                n->m_value = value;
+                inserted = false;
+            }
+            return inserted;
+        }
+
+        static void destroy(node_allocator &allocator, node_pointer n) {
+            if (n) {
+                destroy(allocator, n->m_left);
+                destroy(allocator, n->m_right);
+                node_traits::destroy(allocator, std::addressof(*n));
+                node_traits::deallocate(allocator, n, 1);
+            }
+        }
+
+        template <typename F> static void for_each(const node_pointer &n, F &f) {
+            if (n) {
+                for_each(n->m_left, f);
+                f(n->m_key, n->m_value);
+                for_each(n->m_right, f);
+            }
+        }
+
+    public:
+        offset_map() noexcept : m_root(nullptr), m_size(0), m_seed(2463534242u) {}
+
+        offset_map(const offset_map &) = delete;
+        offset_map &operator=(const offset_map &) = delete;
+
+        // insert or overwrite, returns true if the key was new
+        bool insert(const Allocator &allocator, const K &key, const V &value) {
+            node_allocator a(allocator);
+            if (insert(a, m_root, key, value)) {
+                m_size++;
+                return true;
+            }
+            return false;
+        }
+
+        const V *find(const K &key) const {
+            Compare less;
+            const node *n = m_root.get();
+            while (n != nullptr) {
+                if (less(key, n->m_key)) {
+                    n = n->m_left.get();
+                } else if (less(n->m_key, key)) {
+                    n = n->m_right.get();
+                } else {
+                    return &n->m_value;
+                }
+            }
+            return nullptr;
+        }
+
+        void clear(const Allocator &allocator) {
+            node_allocator a(allocator);
+            destroy(a, m_root);
+            m_root = nullptr;
+            m_size = 0;
+        }
+
+        // visit every entry in key order
+        template <typename F> void for_each(F f) const {
+            for_each(m_root, f);
+        }
+
+        std::size_t size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+    };
+}
+
+#endif //FASTPATH_OFFSET_MAP_H
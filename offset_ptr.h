@@ -0,0 +1,111 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_OFFSET_PTR_H
+#define FASTPATH_OFFSET_PTR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+
+namespace tf {
+
+    // A self-relative pointer: it stores the distance from itself to its target,
+    // so structures built from offset_ptrs stay valid when the memory holding them
+    // is mapped at a different address (see persistent_arena.h). It must only ever
+    // be copied through its own constructors and assignment, never with memcpy.
+    template <typename T> class offset_ptr {
+    public:
+        using element_type = T;
+        using value_type = typename std::remove_cv<T>::type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = T*;
+        using reference = typename std::add_lvalue_reference<T>::type;
+        using iterator_category = std::random_access_iterator_tag;
+
+        template <typename U> using rebind = offset_ptr<U>;
+
+    private:
+        // an offset of 1 can never reach an aligned object, so it stands for null
+        static constexpr std::ptrdiff_t null_offset = 1;
+
+        std::ptrdiff_t m_offset;
+
+        // The arithmetic is done on integers: computed as char* the compiler's alias
+        // analysis assumes the result still points into this offset_ptr, which it
+        // never does, and reorders loads and stores through it.
+        inline void set(const volatile void *p) noexcept {
+            m_offset = p == nullptr ? null_offset : static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(p) - reinterpret_cast<std::uintptr_t>(this));
+        }
+
+    public:
+        offset_ptr() noexcept : m_offset(null_offset) {}
+        offset_ptr(std::nullptr_t) noexcept : m_offset(null_offset) {}
+        offset_ptr(T *p) noexcept { set(p); }
+        offset_ptr(const offset_ptr &other) noexcept { set(other.get()); }
+
+        template <typename U, typename = typename std::enable_if<std::is_convertible<U *, T *>::value>::type>
+        offset_ptr(const offset_ptr<U> &other) noexcept { set(static_cast<T *>(other.get())); }
+
+        offset_ptr &operator=(const offset_ptr &other) noexcept { set(other.get()); return *this; }
+        offset_ptr &operator=(T *p) noexcept { set(p); return *this; }
+        offset_ptr &operator=(std::nullptr_t) noexcept { m_offset = null_offset; return *this; }
+
+        inline T *get() const noexcept {
+            return m_offset == null_offset ? nullptr : reinterpret_cast<T *>(reinterpret_cast<std::uintptr_t>(this) + static_cast<std::uintptr_t>(m_offset));
+        }
+
+        template <typename U = T> static offset_ptr pointer_to(typename std::enable_if<!std::is_void<U>::value, U>::type &r) noexcept {
+            return offset_ptr(&r);
+        }
+
+        template <typename U = T> typename std::enable_if<!std::is_void<U>::value, U>::type &operator*() const noexcept { return *get(); }
+        T *operator->() const noexcept { return get(); }
+        template <typename U = T> typename std::enable_if<!std::is_void<U>::value, U>::type &operator[](std::ptrdiff_t i) const noexcept { return get()[i]; }
+
+        explicit operator bool() const noexcept { return m_offset != null_offset; }
+        bool operator!() const noexcept { return m_offset == null_offset; }
+
+        offset_ptr &operator+=(std::ptrdiff_t n) noexcept { set(get() + n); return *this; }
+        offset_ptr &operator-=(std::ptrdiff_t n) noexcept { set(get() - n); return *this; }
+        offset_ptr &operator++() noexcept { return *this += 1; }
+        offset_ptr &operator--() noexcept { return *this -= 1; }
+        offset_ptr operator++(int) noexcept { offset_ptr r(*this); ++*this; return r; }
+        offset_ptr operator--(int) noexcept { offset_ptr r(*this); --*this; return r; }
+
+        friend offset_ptr operator+(const offset_ptr &p, std::ptrdiff_t n) noexcept { return offset_ptr(p.get() + n); }
+        friend offset_ptr operator-(const offset_ptr &p, std::ptrdiff_t n) noexcept { return offset_ptr(p.get() - n); }
+        friend std::ptrdiff_t operator-(const offset_ptr &a, const offset_ptr &b) noexcept { return a.get() - b.get(); }
+
+        friend bool operator==(const offset_ptr &a, const offset_ptr &b) noexcept { return a.get() == b.get(); }
+        friend bool operator!=(const offset_ptr &a, const offset_ptr &b) noexcept { return a.get() != b.get(); }
+        friend bool operator<(const offset_ptr &a, const offset_ptr &b) noexcept { return a.get() < b.get(); }
+        friend bool operator==(const offset_ptr &a, std::nullptr_t) noexcept { return !a; }
+        friend bool operator!=(const offset_ptr &a, std::nullptr_t) noexcept { return static_cast<bool>(a); }
+    };
+}
+
+#endif //FASTPATH_OFFSET_PTR_H
@@ -6,8 +6,19 @@
 #define FASTPATH_PERFORMANCE_H
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <utility>
 
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 namespace tf {
     template<typename T = std::chrono::milliseconds>
     struct measure {
@@ -19,6 +30,111 @@ namespace tf {
             return duration;
         }
     };
+
+    // A timestamp cheap enough to time single operations with: the time stamp counter
+    // on x86, steady_clock elsewhere. nanoseconds() converts a difference between two
+    // now()s, calibrated against steady_clock the first time it is called.
+    struct tick_clock {
+        static inline std::uint64_t now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+#else
+            return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+        }
+
+        static double nanoseconds(std::uint64_t ticks) noexcept {
+            static const double scale = calibrate();
+            return static_cast<double>(ticks) * scale;
+        }
+
+    private:
+        static double calibrate() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+            const auto start = std::chrono::steady_clock::now();
+            const std::uint64_t ticks = now();
+            while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(20)) {
+            }
+            const std::uint64_t elapsed_ticks = now() - ticks;
+            const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            return elapsed_ticks != 0 ? static_cast<double>(elapsed) / static_cast<double>(elapsed_ticks) : 1.0;
+#else
+            return 1.0;
+#endif
+        }
+    };
+
+    // The process's resident set size in bytes, or 0 where it cannot be read
+    inline std::size_t resident_bytes() noexcept {
+        std::size_t resident = 0;
+#if defined(__linux__)
+        if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+            unsigned long size = 0;
+            unsigned long pages = 0;
+            if (std::fscanf(statm, "%lu %lu", &size, &pages) == 2) {
+                resident = static_cast<std::size_t>(pages) * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            }
+            std::fclose(statm);
+        }
+#endif
+        return resident;
+    }
+
+    // Counts L1 data cache read misses in this thread while a function runs, using
+    // the kernel's hardware counters. Where those are unavailable (not Linux, no
+    // permission, or a virtual machine without a PMU) available() is false.
+    class l1d_miss_counter {
+        int m_fd;
+
+    public:
+        l1d_miss_counter() noexcept : m_fd(-1) {
+#if defined(__linux__)
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            m_fd = static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+        }
+
+        ~l1d_miss_counter() {
+#if defined(__linux__)
+            if (m_fd != -1) {
+                ::close(m_fd);
+            }
+#endif
+        }
+
+        l1d_miss_counter(const l1d_miss_counter &) = delete;
+        l1d_miss_counter &operator=(const l1d_miss_counter &) = delete;
+
+        bool available() const noexcept { return m_fd != -1; }
+
+        template<typename F, typename ...Args>
+        std::uint64_t execution(F &&func, Args &&... args) {
+            std::uint64_t count = 0;
+#if defined(__linux__)
+            if (m_fd != -1) {
+                ::ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+#endif
+            std::forward<decltype(func)>(func)(std::forward<Args>(args)...);
+#if defined(__linux__)
+            if (m_fd != -1) {
+                ::ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+                if (::read(m_fd, &count, sizeof(count)) != sizeof(count)) {
+                    count = 0;
+                }
+            }
+#endif
+            return count;
+        }
+    };
 }
 
 #endif //FASTPATH_PERFORMANCE_H
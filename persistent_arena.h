@@ -0,0 +1,357 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_PERSISTENT_ARENA_H
+#define FASTPATH_PERSISTENT_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "allocation_profiler.h"
+#include "offset_ptr.h"
+#include "optimize.h"
+
+namespace tf {
+
+    // An arena living in a file-backed shared mapping, so whatever is built in it
+    // survives the process and can be reattached on restart without rebuilding.
+    //
+    // The file starts with a header holding a magic number, a format version and a
+    // directory of slabs (as offsets into the file), followed by the slabs
+    // themselves. Because the mapping may land at a different address each time,
+    // structures kept in the arena must link to each other with tf::offset_ptr,
+    // and are found again through the root object recorded in the header.
+    class persistent_arena {
+    public:
+        using value_type = unsigned char;
+        using pointer = value_type*;
+
+        static constexpr std::uint64_t magic = 0x414e455241465450ULL; // "PTFARENA"
+        static constexpr std::uint32_t version = 1;
+        static constexpr std::size_t max_slabs = 4096;
+
+    private:
+        struct slab_entry {
+            std::uint64_t m_offset;
+            std::uint64_t m_size;
+            std::uint64_t m_head;
+            std::uint64_t m_allocated;
+        };
+
+        struct header {
+            std::uint64_t m_magic;
+            std::uint32_t m_version;
+            std::uint32_t m_header_size;
+            std::uint64_t m_slab_size;
+            std::uint64_t m_file_size;
+            std::uint64_t m_root;
+            std::uint64_t m_slab_count;
+            std::uint64_t m_current_slab;
+            slab_entry m_slabs[max_slabs];
+        };
+
+        static inline std::size_t align_up(std::size_t n, std::size_t alignment = 16) noexcept {
+            return (n + (alignment - 1)) & ~(alignment - 1);
+        }
+
+        int m_fd;
+        std::size_t m_capacity;
+        pointer m_base;
+        header *m_header;
+        bool m_created;
+
+        inline pointer at(std::uint64_t offset) const noexcept {
+            return m_base + offset;
+        }
+
+        inline std::uint64_t offset_of(const void *p) const noexcept {
+            return static_cast<std::uint64_t>(static_cast<const value_type *>(p) - m_base);
+        }
+
+        inline slab_entry *find_slab_with_space(std::size_t size) const noexcept {
+            for (std::uint64_t i = 0; i < m_header->m_slab_count; ++i) {
+                slab_entry &s = m_header->m_slabs[i];
+                if (s.m_size - (s.m_head - s.m_offset) >= size) {
+                    return &s;
+                }
+            }
+            return nullptr;
+        }
+
+        // slabs are appended in address order, so the directory can be searched by offset
+        inline slab_entry *find_slab_containing(std::uint64_t offset) const noexcept {
+            slab_entry *begin = m_header->m_slabs;
+            slab_entry *end = begin + m_header->m_slab_count;
+            slab_entry *s = std::upper_bound(begin, end, offset, [](std::uint64_t o, const slab_entry &e) { return o < e.m_offset; });
+            return s == begin ? nullptr : s - 1;
+        }
+
+        slab_entry *add_slab(std::size_t size) {
+            if (m_header->m_slab_count == max_slabs) {
+                throw std::length_error("persistent_arena slab directory is full");
+            }
+            size = align_up(std::max<std::size_t>(size, m_header->m_slab_size), 4096);
+            const std::uint64_t offset = m_header->m_file_size;
+            if (offset + size > m_capacity) {
+                throw std::bad_alloc();
+            }
+            if (::ftruncate(m_fd, static_cast<off_t>(offset + size)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: ftruncate");
+            }
+            m_header->m_file_size = offset + size;
+
+            slab_entry &s = m_header->m_slabs[m_header->m_slab_count];
+            s.m_offset = offset;
+            s.m_size = size;
+            s.m_head = offset;
+            s.m_allocated = 0;
+            m_header->m_current_slab = m_header->m_slab_count++;
+            return &s;
+        }
+
+        void initialise(std::size_t slab_size) {
+            const std::size_t header_size = align_up(sizeof(header), 4096);
+            // the header and the first slab have to fit in the mapping
+            if (m_capacity < header_size + align_up(slab_size, 4096)) {
+                throw std::runtime_error("persistent_arena: capacity is too small for the header and the first slab");
+            }
+            if (::ftruncate(m_fd, static_cast<off_t>(header_size)) != 0) {
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: ftruncate");
+            }
+            std::memset(m_base, 0, sizeof(header));
+            m_header->m_version = version;
+            m_header->m_header_size = static_cast<std::uint32_t>(sizeof(header));
+            m_header->m_slab_size = slab_size;
+            m_header->m_file_size = header_size;
+            add_slab(slab_size);
+            // written last, so a file left half initialised is never mistaken for a valid one
+            m_header->m_magic = magic;
+        }
+
+        void validate(std::size_t file_size) const {
+            // checked before anything past the first page is read, so it is all mapped
+            if (file_size > m_capacity) {
+                throw std::runtime_error("persistent_arena: arena file is larger than the requested capacity");
+            }
+            if (m_header->m_magic != magic) {
+                throw std::runtime_error("persistent_arena: not an arena file");
+            }
+            if (m_header->m_version != version || m_header->m_header_size != sizeof(header)) {
+                throw std::runtime_error("persistent_arena: incompatible arena file version");
+            }
+            if (m_header->m_file_size > m_capacity) {
+                throw std::runtime_error("persistent_arena: arena file is larger than the requested capacity");
+            }
+            // pages past the end of a truncated file would raise SIGBUS on first access
+            if (file_size < m_header->m_file_size) {
+                throw std::runtime_error("persistent_arena: arena file is truncated");
+            }
+
+            // the directory is indexed and searched without further checks, so a corrupt
+            // one is rejected here rather than read out of bounds later
+            const std::uint64_t count = m_header->m_slab_count;
+            if (count == 0 || count > max_slabs || m_header->m_current_slab >= count) {
+                throw std::runtime_error("persistent_arena: corrupt slab directory");
+            }
+            std::uint64_t end = align_up(sizeof(header), 4096);
+            for (std::uint64_t i = 0; i < count; ++i) {
+                const slab_entry &s = m_header->m_slabs[i];
+                // in ascending order, clear of the header and of each other, and inside the file
+                if (s.m_offset < end || s.m_size > m_header->m_file_size || s.m_offset > m_header->m_file_size - s.m_size
+                    || s.m_head < s.m_offset || s.m_head - s.m_offset > s.m_size) {
+                    throw std::runtime_error("persistent_arena: corrupt slab directory");
+                }
+                end = s.m_offset + s.m_size;
+            }
+        }
+
+    public:
+        // Map 'path' with room to grow to 'capacity' bytes, creating and initialising
+        // the file if it does not already hold an arena.
+        persistent_arena(const std::string &path, std::size_t capacity, std::size_t slab_size = 1024 * 1024) : m_fd(-1), m_capacity(capacity), m_base(nullptr), m_header(nullptr), m_created(false) {
+            m_fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (m_fd < 0) {
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: open " + path);
+            }
+
+            struct stat st;
+            if (::fstat(m_fd, &st) != 0) {
+                ::close(m_fd);
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: stat " + path);
+            }
+
+            // reserve the whole capacity up front, so the mapping never moves as the file grows
+            void *p = ::mmap(nullptr, m_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(m_fd);
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: mmap " + path);
+            }
+            m_base = static_cast<pointer>(p);
+            m_header = reinterpret_cast<header *>(m_base);
+
+            try {
+                if (st.st_size == 0) {
+                    m_created = true;
+                    initialise(slab_size);
+                } else if (static_cast<std::size_t>(st.st_size) < sizeof(header)) {
+                    throw std::runtime_error("persistent_arena: not an arena file");
+                } else {
+                    validate(static_cast<std::size_t>(st.st_size));
+                }
+            } catch (...) {
+                ::munmap(m_base, m_capacity);
+                ::close(m_fd);
+                throw;
+            }
+        }
+
+        ~persistent_arena() {
+            ::munmap(m_base, m_capacity);
+            ::close(m_fd);
+        }
+
+        persistent_arena(const persistent_arena&) = delete;
+        persistent_arena& operator=(const persistent_arena&) = delete;
+
+        // true if this arena was created empty rather than reattached from an existing file
+        bool created() const noexcept { return m_created; }
+
+        persistent_arena::pointer allocate(std::size_t size) {
+            // zero byte blocks still take one unit, so each is a distinct address
+            const std::size_t used = align_up(std::max<std::size_t>(size, 1));
+            slab_entry *s = &m_header->m_slabs[m_header->m_current_slab];
+            if (unlikely(s->m_size - (s->m_head - s->m_offset) < used)) {
+                if ((s = find_slab_with_space(used)) == nullptr) {
+                    s = add_slab(used);
+                }
+            }
+            pointer p = at(s->m_head);
+            s->m_head += used;
+            s->m_allocated += used;
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        void deallocate(persistent_arena::pointer p, std::size_t size) noexcept {
+            allocation_profiler::deallocated(p);
+            size = align_up(std::max<std::size_t>(size, 1));
+            const std::uint64_t offset = offset_of(p);
+            slab_entry *s = find_slab_containing(offset);
+            assert(s != nullptr && offset < s->m_offset + s->m_size);
+            if (s != nullptr) {
+                if ((s->m_allocated -= size) == 0) {
+                    s->m_head = s->m_offset;
+                } else if (offset + size == s->m_head) {
+                    s->m_head = offset;
+                }
+            }
+        }
+
+        // the object structures are reattached through, or nullptr in a new arena
+        template <typename T> T *root() const noexcept {
+            return m_header->m_root == 0 ? nullptr : reinterpret_cast<T *>(at(m_header->m_root));
+        }
+
+        void set_root(const void *p) noexcept {
+            m_header->m_root = p == nullptr ? 0 : offset_of(p);
+        }
+
+        // write everything back to the file
+        void flush() {
+            if (::msync(m_base, m_header->m_file_size, MS_SYNC) != 0) {
+                throw std::system_error(errno, std::generic_category(), "persistent_arena: msync");
+            }
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const persistent_arena &a) {
+            std::size_t total_free = 0;
+            std::size_t total_capacity = 0;
+            std::size_t total_allocated = 0;
+
+            for (std::uint64_t i = 0; i < a.m_header->m_slab_count; ++i) {
+                const slab_entry &s = a.m_header->m_slabs[i];
+                total_free += s.m_size - (s.m_head - s.m_offset);
+                total_capacity += s.m_size;
+                total_allocated += s.m_allocated;
+            }
+
+            out << "allocated: " << total_allocated << " capacity: " << total_capacity << " allocatable: " << total_free << " from " << a.m_header->m_slab_count << " blocks";
+            return out;
+        }
+    };
+
+    // An allocator handing out offset_ptrs into a persistent_arena, so containers
+    // written against allocator_traits<>::pointer can live inside the arena.
+    template <typename T> class persistent_allocator {
+    public:
+        typedef T value_type;
+        typedef offset_ptr<T> pointer;
+        typedef offset_ptr<const T> const_pointer;
+        typedef std::size_t size_type;
+        typedef std::ptrdiff_t difference_type;
+
+        using arena_type = persistent_arena;
+
+    private:
+        arena_type *m_arena;
+
+        template <typename U> friend class persistent_allocator;
+
+    public:
+        template<typename U> struct rebind {
+            typedef persistent_allocator<U> other;
+        };
+
+        persistent_allocator(arena_type &arena) noexcept : m_arena(&arena) {}
+
+        template <typename U> persistent_allocator(const persistent_allocator<U> &other) noexcept : m_arena(other.m_arena) {}
+
+        inline pointer allocate(const std::size_t size) {
+            return pointer(reinterpret_cast<T *>(m_arena->allocate(size * sizeof(T))));
+        }
+
+        inline void deallocate(pointer p, std::size_t size) noexcept {
+            m_arena->deallocate(reinterpret_cast<typename arena_type::pointer>(p.get()), size * sizeof(T));
+        }
+
+        arena_type &arena() const noexcept { return *m_arena; }
+
+        template <typename U> bool operator==(const persistent_allocator<U> &other) const noexcept { return m_arena == other.m_arena; }
+        template <typename U> bool operator!=(const persistent_allocator<U> &other) const noexcept { return m_arena != other.m_arena; }
+    };
+}
+
+#endif //FASTPATH_PERSISTENT_ARENA_H
@@ -0,0 +1,152 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_SLAB_EXCHANGE_H
+#define FASTPATH_SLAB_EXCHANGE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#if defined(__linux__)
+#include <sched.h>
+#endif
+#include "optimize.h"
+
+namespace tf {
+
+    // The default for tf::new_arena: spare slabs are never shared between threads
+    struct no_slab_exchange {
+        static constexpr bool enabled = false;
+
+        inline bool publish(void *, std::size_t) noexcept { return false; }
+        inline void *take(std::size_t) noexcept { return nullptr; }
+        template <typename F> inline void drain(F) noexcept {}
+    };
+
+    // A global, lock-free exchange of empty slabs between threads.
+    //
+    // Each NUMA node has a fixed array of slots, so the exchange is naturally
+    // bounded: a thread publishes a spare slab into a free slot on its own node
+    // (or is told to free it itself when the node is full), and a thread that
+    // has run dry takes a slab from its own node before stealing from the
+    // others. Slots hold the slab address with log2 of its (power of two) size
+    // packed into the top byte, so a taker can choose a slab without touching
+    // one another thread may be about to claim.
+    template <std::size_t Slots = 64, std::size_t Nodes = 4> class slab_exchange {
+    public:
+        static constexpr bool enabled = true;
+
+    private:
+        static constexpr int size_shift = 56;
+        static constexpr std::uint64_t address_mask = (std::uint64_t(1) << size_shift) - 1;
+
+        struct alignas(64) node_slots {
+            std::atomic<std::uint64_t> m_slots[Slots];
+        };
+
+        node_slots m_nodes[Nodes];
+
+        static inline unsigned log2(std::size_t size) noexcept {
+            return static_cast<unsigned>(63 - __builtin_clzll(size));
+        }
+
+        // the node the calling thread last ran on, looked up once per thread
+        static std::size_t current_node() noexcept {
+            static __thread int node = -1;
+            if (unlikely(node < 0)) {
+                unsigned cpu = 0;
+                unsigned n = 0;
+#if defined(__linux__) && defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 29))
+                if (::getcpu(&cpu, &n) != 0) {
+                    n = 0;
+                }
+#endif
+                node = static_cast<int>(n);
+            }
+            return static_cast<std::size_t>(node) % Nodes;
+        }
+
+        inline void *take_from(node_slots &node, unsigned min_log2) noexcept {
+            for (std::size_t i = 0; i < Slots; ++i) {
+                std::uint64_t slot = node.m_slots[i].load(std::memory_order_relaxed);
+                if (slot != 0 && (slot >> size_shift) >= min_log2 && node.m_slots[i].compare_exchange_strong(slot, 0, std::memory_order_acquire, std::memory_order_relaxed)) {
+                    return reinterpret_cast<void *>(slot & address_mask);
+                }
+            }
+            return nullptr;
+        }
+
+    public:
+        slab_exchange() noexcept {
+            for (node_slots &node : m_nodes) {
+                for (std::atomic<std::uint64_t> &slot : node.m_slots) {
+                    slot.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        slab_exchange(const slab_exchange &) = delete;
+        slab_exchange &operator=(const slab_exchange &) = delete;
+
+        // offer an empty slab of 'size' bytes (a power of two), returns false if the caller must keep or free it
+        bool publish(void *slab, std::size_t size) noexcept {
+            const std::uint64_t packed = reinterpret_cast<std::uint64_t>(slab) | (std::uint64_t(log2(size)) << size_shift);
+            node_slots &node = m_nodes[current_node()];
+            for (std::size_t i = 0; i < Slots; ++i) {
+                std::uint64_t expected = 0;
+                if (node.m_slots[i].load(std::memory_order_relaxed) == 0 && node.m_slots[i].compare_exchange_strong(expected, packed, std::memory_order_release, std::memory_order_relaxed)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // claim a published slab of at least 'size' bytes, preferring the caller's own node
+        void *take(std::size_t size) noexcept {
+            const unsigned min_log2 = size <= 1 ? 0 : log2(size - 1) + 1;
+            const std::size_t home = current_node();
+            for (std::size_t n = 0; n < Nodes; ++n) {
+                if (void *slab = take_from(m_nodes[(home + n) % Nodes], min_log2)) {
+                    return slab;
+                }
+            }
+            return nullptr;
+        }
+
+        // remove every slab still held, handing each to 'release'
+        template <typename F> void drain(F release) noexcept {
+            for (node_slots &node : m_nodes) {
+                for (std::atomic<std::uint64_t> &slot : node.m_slots) {
+                    std::uint64_t s = slot.exchange(0, std::memory_order_acquire);
+                    if (s != 0) {
+                        release(reinterpret_cast<void *>(s & address_mask));
+                    }
+                }
+            }
+        }
+    };
+}
+
+#endif //FASTPATH_SLAB_EXCHANGE_H
@@ -0,0 +1,92 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_SLAB_GROWTH_H
+#define FASTPATH_SLAB_GROWTH_H
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+
+namespace tf {
+
+    // the smallest power of two not less than n (n itself if it already is one), for any width of size_t
+    inline std::size_t round_up_pow2(std::size_t n) noexcept {
+        n--;
+        for (std::size_t shift = 1; shift < std::numeric_limits<std::size_t>::digits; shift <<= 1) {
+            n |= n >> shift;
+        }
+        return n + 1;
+    }
+
+    // Growth policies decide how big each new slab an arena creates should be.
+    //
+    // next_size() is given the bytes the triggering allocation needs, the arena's
+    // initial slab size and, for policies that set tracks_demand, the bytes live in
+    // the arena at the time. Policies are trivially constructible so that the
+    // thread-local new_arena can hold one per thread; zero means "no history".
+
+    // every slab the initial size, or just big enough for an oversized request
+    struct fixed_growth {
+        static constexpr bool tracks_demand = false;
+
+        std::size_t next_size(std::size_t required, std::size_t initial, std::size_t) noexcept {
+            return std::max(required, initial);
+        }
+    };
+
+    // each slab twice the size of the one before, up to MaxSize
+    template <std::size_t MaxSize = 16 * 1024 * 1024> struct geometric_growth {
+        static constexpr bool tracks_demand = false;
+
+        std::size_t m_slabs;
+
+        std::size_t next_size(std::size_t required, std::size_t initial, std::size_t) noexcept {
+            std::size_t size = initial;
+            for (std::size_t i = 0; i < m_slabs && size < MaxSize; ++i) {
+                size *= 2;
+            }
+            m_slabs++;
+            return std::max(required, std::min(size, std::max(initial, MaxSize)));
+        }
+    };
+
+    // Slabs sized to a quarter of the bytes live when one is needed, smoothed over
+    // the last few slabs, so they grow while demand grows and shrink again once it
+    // falls, between the initial size and MaxSize.
+    template <std::size_t MaxSize = 16 * 1024 * 1024> struct adaptive_growth {
+        static constexpr bool tracks_demand = true;
+
+        std::size_t m_demand;
+
+        std::size_t next_size(std::size_t required, std::size_t initial, std::size_t live) noexcept {
+            m_demand = m_demand == 0 ? live : (m_demand * 3 + live) / 4;
+            const std::size_t size = std::min(round_up_pow2(std::max(initial, m_demand / 4)), std::max(initial, MaxSize));
+            return std::max(required, size);
+        }
+    };
+}
+
+#endif //FASTPATH_SLAB_GROWTH_H
@@ -0,0 +1,191 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_SLAB_MEMORY_H
+#define FASTPATH_SLAB_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace tf {
+
+    // Where the arenas get slab memory from, and when they give untouched pages back.
+    //
+    // Slabs of at least reserve_threshold bytes are reserved with mmap, so only the
+    // pages the bump pointer has actually passed over are ever committed. When the
+    // bump pointer falls back (the slab empties, or its top blocks are freed) and the
+    // pages touched above it reach release bytes, everything beyond the first retain
+    // bytes is returned with madvise. The gap between retain and release is the
+    // hysteresis that stops a slab which fills and empties repeatedly from paying
+    // for a madvise and the page faults after it on every cycle.
+    struct commit_policy {
+        std::size_t m_reserve_threshold;
+        std::size_t m_retain;
+        std::size_t m_release;
+        int m_advice;
+
+        // MADV_FREE (Linux 4.5) lets the kernel take the pages lazily, under memory
+        // pressure, and is much cheaper than MADV_DONTNEED, but RSS only drops once
+        // the kernel actually does so
+#if defined(MADV_FREE)
+        static constexpr int lazy_advice = MADV_FREE;
+#else
+        static constexpr int lazy_advice = MADV_DONTNEED;
+#endif
+
+        explicit commit_policy(std::size_t reserve_threshold = 64 * 1024, std::size_t retain = 64 * 1024, std::size_t release = 256 * 1024, int advice = lazy_advice) noexcept
+            : m_reserve_threshold(reserve_threshold), m_retain(retain), m_release(release), m_advice(advice) {}
+
+        // every slab from malloc, nothing ever handed back
+        static commit_policy never() noexcept {
+            return commit_policy(std::numeric_limits<std::size_t>::max());
+        }
+    };
+
+    // Opt-in warm-up for latency-critical start-up: an arena given one creates its first
+    // m_slabs slabs (the initial one included) straight away, with every page faulted
+    // in, so the first allocations don't each take a page fault. touch writes to each
+    // page; populate asks mmap to do it with MAP_POPULATE, and touches slabs that come
+    // from malloc. With m_lock the slabs are also mlock'ed so they are never paged out,
+    // which RLIMIT_MEMLOCK may refuse, in which case they are simply left unlocked.
+    // Locked slabs are never trimmed.
+    struct warm_up {
+        enum prefault_mode { no_prefault, touch, populate };
+
+        prefault_mode m_prefault;
+        bool m_lock;
+        std::size_t m_slabs;
+
+        explicit warm_up(prefault_mode prefault = populate, bool lock = false, std::size_t slabs = 1) noexcept
+            : m_prefault(prefault), m_lock(lock), m_slabs(slabs) {}
+    };
+
+    struct slab_memory {
+        static std::size_t page_size() noexcept {
+            static const std::size_t size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+            return size;
+        }
+
+        static unsigned char *page_up(unsigned char *p) noexcept {
+            const std::uintptr_t mask = page_size() - 1;
+            return reinterpret_cast<unsigned char *>((reinterpret_cast<std::uintptr_t>(p) + mask) & ~mask);
+        }
+
+        // 'size' bytes aligned to at least 'alignment', reserved rather than committed if the
+        // policy says so, unless 'prefault' asks for the pages to be faulted in up front
+        static void *allocate(std::size_t size, std::size_t alignment, const commit_policy &policy, bool &mapped, warm_up::prefault_mode prefault = warm_up::no_prefault) {
+            mapped = size >= policy.m_reserve_threshold;
+            if (mapped) {
+                int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+#if defined(MAP_POPULATE)
+                if (prefault == warm_up::populate) {
+                    flags |= MAP_POPULATE;
+                    prefault = warm_up::no_prefault;
+                }
+#endif
+                void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+                if (p == MAP_FAILED) {
+                    throw std::bad_alloc();
+                }
+                if (prefault != warm_up::no_prefault) {
+                    touch(p, size);
+                }
+                return p;
+            }
+
+            void *p = nullptr;
+            if (::posix_memalign(&p, alignment, size) != 0) {
+                throw std::bad_alloc();
+            }
+            if (prefault != warm_up::no_prefault) {
+                touch(p, size);
+            }
+            return p;
+        }
+
+        // fault in every page of [p, p + size) by writing a zero to it, which leaves fresh
+        // mappings reading as all zero
+        static void touch(void *p, std::size_t size) noexcept {
+            volatile unsigned char *c = static_cast<unsigned char *>(p);
+            for (std::size_t offset = 0; offset < size; offset += page_size()) {
+                c[offset] = 0;
+            }
+            if (size != 0) {
+                c[size - 1] = 0;
+            }
+        }
+
+        // keep [p, p + size) resident, returns false if the kernel refused
+        static bool lock(void *p, std::size_t size) noexcept {
+            return ::mlock(p, size) == 0;
+        }
+
+        static void unlock(void *p, std::size_t size) noexcept {
+            ::munlock(p, size);
+        }
+
+        static void deallocate(void *p, std::size_t size, bool mapped) noexcept {
+            if (mapped) {
+                ::munmap(p, size);
+            } else {
+                ::free(p);
+            }
+        }
+
+        // whether pages released under 'policy' read back as zero: MADV_FREE'd pages the
+        // kernel has not got round to taking keep their contents
+        static bool releases_zeroed(const commit_policy &policy) noexcept {
+            return policy.m_advice == MADV_DONTNEED;
+        }
+
+        // Called once the bump pointer has fallen back to 'head'. Returns the new end of
+        // the pages that may be dirty, which was 'dirty' and is lowered if pages were released.
+        static unsigned char *trim(unsigned char *head, unsigned char *dirty, const commit_policy &policy) noexcept {
+            if (dirty <= head || static_cast<std::size_t>(dirty - head) < policy.m_release) {
+                return dirty;
+            }
+            unsigned char *keep = page_up(head + policy.m_retain);
+            if (keep < dirty) {
+                const std::size_t length = static_cast<std::size_t>(page_up(dirty) - keep);
+                if (::madvise(keep, length, policy.m_advice) != 0) {
+                    // kernels before 4.5 reject MADV_FREE; if DONTNEED fails too (the pages are
+                    // locked, say) nothing was released and the pages keep their contents
+                    if (policy.m_advice == MADV_DONTNEED || ::madvise(keep, length, MADV_DONTNEED) != 0) {
+                        return dirty;
+                    }
+                }
+                return keep;
+            }
+            return dirty;
+        }
+    };
+}
+
+#endif //FASTPATH_SLAB_MEMORY_H
@@ -0,0 +1,254 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_SMALL_VECTOR_H
+#define FASTPATH_SMALL_VECTOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "expand_allocator_traits.h"
+#include "fast_linear_allocator.h"
+#include "optimize.h"
+
+namespace tf {
+
+    // A non-owning view of contiguous elements, std::span for those of us still on C++14
+    template <typename T> class span {
+    public:
+        using element_type = T;
+        using value_type = typename std::remove_cv<T>::type;
+        using size_type = std::size_t;
+        using iterator = T *;
+
+    private:
+        T *m_data;
+        size_type m_size;
+
+    public:
+        span() noexcept : m_data(nullptr), m_size(0) {}
+        span(T *data, size_type size) noexcept : m_data(data), m_size(size) {}
+
+        template <typename U, typename = typename std::enable_if<std::is_convertible<U (*)[], T (*)[]>::value>::type>
+        span(const span<U> &other) noexcept : m_data(other.data()), m_size(other.size()) {}
+
+        T *data() const noexcept { return m_data; }
+        size_type size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+
+        T &operator[](size_type i) const noexcept { return m_data[i]; }
+
+        iterator begin() const noexcept { return m_data; }
+        iterator end() const noexcept { return m_data + m_size; }
+    };
+
+    // A vector holding up to N elements inline and spilling into its allocator, by
+    // default a tf::arena, beyond that. Once spilled it grows in place through the
+    // allocator's expand() (see expand_allocator_traits.h) where it can, which for
+    // the arenas is whenever its buffer is still the last block in the slab.
+    template <typename T, std::size_t N, typename Allocator = linear_allocator<T>> class small_vector {
+    public:
+        using value_type = T;
+        using allocator_type = Allocator;
+        using size_type = std::size_t;
+        using reference = value_type &;
+        using const_reference = const value_type &;
+        using iterator = value_type *;
+        using const_iterator = const value_type *;
+
+        static constexpr size_type inline_capacity = N;
+
+    private:
+        using traits = std::allocator_traits<Allocator>;
+
+        static_assert(std::is_same<typename traits::pointer, T *>::value, "small_vector needs an allocator with raw pointers");
+        static_assert(N > 0, "small_vector needs room for at least one inline element");
+
+        allocator_type m_allocator;
+        T *m_begin;
+        size_type m_size;
+        size_type m_capacity;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type m_inline[N > 0 ? N : 1];
+
+        inline T *inline_buffer() noexcept {
+            return reinterpret_cast<T *>(m_inline);
+        }
+
+        // move the elements to 'to', leaving nothing to destroy behind
+        void relocate(T *to, std::true_type) noexcept {
+            std::memcpy(static_cast<void *>(to), m_begin, m_size * sizeof(T));
+        }
+
+        void relocate(T *to, std::false_type) {
+            for (size_type i = 0; i < m_size; ++i) {
+                traits::construct(m_allocator, to + i, std::move_if_noexcept(m_begin[i]));
+                traits::destroy(m_allocator, m_begin + i);
+            }
+        }
+
+        template <typename InputIt> void copy_construct(T *to, InputIt first, InputIt last, std::false_type) {
+            for (; first != last; ++first, ++to) {
+                traits::construct(m_allocator, to, *first);
+            }
+        }
+
+        void copy_construct(T *to, const T *first, const T *last, std::true_type) noexcept {
+            std::memcpy(static_cast<void *>(to), first, static_cast<size_type>(last - first) * sizeof(T));
+        }
+
+        void grow(size_type capacity) {
+            grow(capacity, [](T *) {});
+        }
+
+        // As above, with 'construct' building the new elements just past the existing ones
+        // before the old buffer is relocated and released, as std::vector does, so a
+        // source inside the vector itself (v.push_back(v[0]), s += s) is still intact
+        // when it is copied.
+        template <typename Construct> void grow(size_type capacity, Construct &&construct) {
+            if (!is_inline() && expand_allocator_traits<Allocator>::expand(m_allocator, m_begin, m_capacity, capacity)) {
+                m_capacity = capacity;
+                construct(m_begin + m_size);
+                return;
+            }
+
+            auto block = expand_allocator_traits<Allocator>::allocate_at_least(m_allocator, capacity);
+            try {
+                construct(block.ptr + m_size);
+            } catch (...) {
+                traits::deallocate(m_allocator, block.ptr, block.count);
+                throw;
+            }
+            relocate(block.ptr, std::is_trivially_copyable<T>());
+            release();
+            m_begin = block.ptr;
+            m_capacity = block.count;
+        }
+
+        void release() noexcept {
+            if (!is_inline()) {
+                traits::deallocate(m_allocator, m_begin, m_capacity);
+            }
+        }
+
+    public:
+        explicit small_vector(const allocator_type &allocator) : m_allocator(allocator), m_begin(inline_buffer()), m_size(0), m_capacity(N) {}
+
+        small_vector(small_vector &&other) noexcept(std::is_nothrow_move_constructible<T>::value) : m_allocator(other.m_allocator), m_begin(inline_buffer()), m_size(0), m_capacity(N) {
+            if (other.is_inline()) {
+                other.relocate(m_begin, std::is_trivially_copyable<T>());
+                m_size = other.m_size;
+                other.m_size = 0;
+            } else {
+                m_begin = other.m_begin;
+                m_size = other.m_size;
+                m_capacity = other.m_capacity;
+                other.m_begin = other.inline_buffer();
+                other.m_size = 0;
+                other.m_capacity = N;
+            }
+        }
+
+        ~small_vector() {
+            clear();
+            release();
+        }
+
+        small_vector(const small_vector &) = delete;
+        small_vector &operator=(const small_vector &) = delete;
+
+        void reserve(size_type capacity) {
+            if (capacity > m_capacity) {
+                grow(capacity);
+            }
+        }
+
+        template <typename ...Args> reference emplace_back(Args &&... args) {
+            if (unlikely(m_size == m_capacity)) {
+                grow(m_capacity * 2, [&](T *to) { traits::construct(m_allocator, to, std::forward<Args>(args)...); });
+            } else {
+                traits::construct(m_allocator, m_begin + m_size, std::forward<Args>(args)...);
+            }
+            return m_begin[m_size++];
+        }
+
+        void push_back(const value_type &value) { emplace_back(value); }
+        void push_back(value_type &&value) { emplace_back(std::move(value)); }
+
+        // append a run of elements with at most one growth step
+        template <typename InputIt> void append(InputIt first, InputIt last) {
+            const size_type count = static_cast<size_type>(std::distance(first, last));
+            const std::integral_constant<bool, std::is_trivially_copyable<T>::value && std::is_convertible<InputIt, const T *>::value> trivial;
+            if (m_size + count > m_capacity) {
+                grow(std::max(m_size + count, m_capacity * 2), [&](T *to) { copy_construct(to, first, last, trivial); });
+            } else {
+                copy_construct(m_begin + m_size, first, last, trivial);
+            }
+            m_size += count;
+        }
+
+        void pop_back() {
+            traits::destroy(m_allocator, m_begin + --m_size);
+        }
+
+        void clear() {
+            while (m_size != 0) {
+                pop_back();
+            }
+        }
+
+        // true until the elements outgrow the inline storage
+        bool is_inline() const noexcept { return m_begin == reinterpret_cast<const T *>(m_inline); }
+
+        size_type size() const noexcept { return m_size; }
+        size_type capacity() const noexcept { return m_capacity; }
+        bool empty() const noexcept { return m_size == 0; }
+
+        value_type *data() noexcept { return m_begin; }
+        const value_type *data() const noexcept { return m_begin; }
+
+        reference operator[](size_type i) noexcept { return m_begin[i]; }
+        const_reference operator[](size_type i) const noexcept { return m_begin[i]; }
+
+        reference back() noexcept { return m_begin[m_size - 1]; }
+        const_reference back() const noexcept { return m_begin[m_size - 1]; }
+
+        iterator begin() noexcept { return m_begin; }
+        iterator end() noexcept { return m_begin + m_size; }
+        const_iterator begin() const noexcept { return m_begin; }
+        const_iterator end() const noexcept { return m_begin + m_size; }
+
+        tf::span<T> view() noexcept { return tf::span<T>(m_begin, m_size); }
+        tf::span<const T> view() const noexcept { return tf::span<const T>(m_begin, m_size); }
+
+        allocator_type get_allocator() const { return m_allocator; }
+    };
+}
+
+#endif //FASTPATH_SMALL_VECTOR_H
@@ -0,0 +1,406 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_TLSF_ARENA_H
+#define FASTPATH_TLSF_ARENA_H
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <ostream>
+#include "allocation_profiler.h"
+#include "lock_policy.h"
+#include "optimize.h"
+#include "slab_growth.h"
+#include "slab_memory.h"
+
+namespace tf {
+
+    // A Two-Level Segregated Fit arena (Masmano et al., "TLSF: a new dynamic memory
+    // allocator for real-time systems"), for workloads that free in any order and
+    // would leave a bump arena's slabs full of holes it can never reuse.
+    //
+    // Free blocks are kept in lists by size class: the first level is the power of two
+    // below the size, the second splits that range into 16 equal steps. One bitmap
+    // says which first level ranges have any free block, one per range which of its
+    // lists do, so finding a block big enough is two bit scans, whatever the state of
+    // the arena. Each block carries a 16 byte header with its size and its physical
+    // predecessor, so a freed block is merged with free neighbours on either side at
+    // once, and there are never two free blocks next to each other. Allocation and
+    // free are O(1); only allocation that has to add a pool does more.
+    //
+    // Pools come from slab_memory, as the bump arenas' slabs do, sized by the Growth
+    // policy, and are given back when the arena is destroyed. Lock is as for
+    // linear_arena.
+    template <typename Growth = fixed_growth, typename Lock = null_lock> class tlsf_arena {
+    public:
+        typedef unsigned char value_type;
+        typedef value_type * pointer;
+
+    private:
+        static constexpr std::size_t alignment_log2 = 4;
+        static constexpr std::size_t alignment = std::size_t(1) << alignment_log2;
+        static constexpr std::size_t sl_log2 = 4;
+        static constexpr std::size_t sl_count = std::size_t(1) << sl_log2;
+        // sizes below small_size all go in the first level, one list per alignment step
+        static constexpr std::size_t fl_shift = sl_log2 + alignment_log2;
+        static constexpr std::size_t small_size = std::size_t(1) << fl_shift;
+        // blocks of up to 2^fl_max bytes
+        static constexpr std::size_t fl_max = 40;
+        static constexpr std::size_t fl_count = fl_max - fl_shift + 1;
+
+        static constexpr std::size_t free_bit = 1;
+
+        struct block {
+            // the block before this one in its pool, nullptr for the first
+            block *m_prev_physical;
+            // payload bytes, a multiple of the alignment, and free_bit
+            std::size_t m_size;
+            // only while the block is free, in what is otherwise its payload
+            block *m_next_free;
+            block *m_prev_free;
+
+            inline std::size_t size() const noexcept { return m_size & ~free_bit; }
+            inline bool is_free() const noexcept { return (m_size & free_bit) != 0; }
+
+            inline pointer payload() noexcept { return reinterpret_cast<pointer>(this) + header_size; }
+            inline block *next_physical() noexcept { return reinterpret_cast<block *>(payload() + size()); }
+
+            static inline block *from_payload(pointer p) noexcept { return reinterpret_cast<block *>(p - header_size); }
+        };
+
+        static constexpr std::size_t header_size = 2 * sizeof(void *);
+        static constexpr std::size_t min_payload = 2 * sizeof(void *);
+        static_assert(header_size % alignment == 0, "payloads must stay aligned");
+
+        // at the front of each pool, followed by its blocks and a zero sized sentinel that is never free
+        struct alignas(16) pool {
+            pool *m_next;
+            std::size_t m_size;
+            bool m_mapped;
+        };
+
+        std::size_t m_initial_size;
+        commit_policy m_policy;
+        Growth m_growth;
+        mutable Lock m_lock;
+
+        std::uint64_t m_fl_bitmap;
+        std::uint32_t m_sl_bitmap[fl_count];
+        block *m_free[fl_count][sl_count];
+
+        pool *m_pools;
+        std::size_t m_reserved;
+        std::size_t m_used;
+
+        static inline std::size_t adjust(std::size_t size) noexcept {
+            return std::max((size + (alignment - 1)) & ~(alignment - 1), min_payload);
+        }
+
+        static inline std::size_t fls(std::size_t n) noexcept {
+            return static_cast<std::size_t>(63 - __builtin_clzll(static_cast<unsigned long long>(n)));
+        }
+
+        // the list a free block of 'size' bytes belongs in
+        static inline void mapping_insert(std::size_t size, std::size_t &fl, std::size_t &sl) noexcept {
+            if (size < small_size) {
+                fl = 0;
+                sl = size / (small_size / sl_count);
+            } else {
+                const std::size_t f = fls(size);
+                sl = (size >> (f - sl_log2)) ^ sl_count;
+                fl = f - (fl_shift - 1);
+            }
+        }
+
+        // the first list whose every block is at least 'size' bytes
+        static inline void mapping_search(std::size_t size, std::size_t &fl, std::size_t &sl) noexcept {
+            if (size >= small_size) {
+                size += (std::size_t(1) << (fls(size) - sl_log2)) - 1;
+            }
+            mapping_insert(size, fl, sl);
+        }
+
+        inline block *search_suitable(std::size_t &fl, std::size_t &sl) const noexcept {
+            std::uint32_t sl_map = m_sl_bitmap[fl] & (~std::uint32_t(0) << sl);
+            if (sl_map == 0) {
+                const std::uint64_t fl_map = m_fl_bitmap & (~std::uint64_t(0) << (fl + 1));
+                if (fl_map == 0) {
+                    return nullptr;
+                }
+                fl = static_cast<std::size_t>(__builtin_ctzll(fl_map));
+                sl_map = m_sl_bitmap[fl];
+            }
+            sl = static_cast<std::size_t>(__builtin_ctz(sl_map));
+            return m_free[fl][sl];
+        }
+
+        inline void insert_free(block *b) noexcept {
+            std::size_t fl, sl;
+            mapping_insert(b->size(), fl, sl);
+            b->m_size |= free_bit;
+            b->m_prev_free = nullptr;
+            b->m_next_free = m_free[fl][sl];
+            if (b->m_next_free != nullptr) {
+                b->m_next_free->m_prev_free = b;
+            }
+            m_free[fl][sl] = b;
+            m_fl_bitmap |= std::uint64_t(1) << fl;
+            m_sl_bitmap[fl] |= std::uint32_t(1) << sl;
+        }
+
+        inline void remove_free(block *b) noexcept {
+            std::size_t fl, sl;
+            mapping_insert(b->size(), fl, sl);
+            if (b->m_prev_free != nullptr) {
+                b->m_prev_free->m_next_free = b->m_next_free;
+            } else {
+                m_free[fl][sl] = b->m_next_free;
+                if (b->m_next_free == nullptr) {
+                    m_sl_bitmap[fl] &= ~(std::uint32_t(1) << sl);
+                    if (m_sl_bitmap[fl] == 0) {
+                        m_fl_bitmap &= ~(std::uint64_t(1) << fl);
+                    }
+                }
+            }
+            if (b->m_next_free != nullptr) {
+                b->m_next_free->m_prev_free = b->m_prev_free;
+            }
+            b->m_size &= ~free_bit;
+        }
+
+        // cut whatever 'b' (in use) has beyond 'size' bytes off into a free block of its own
+        inline void split(block *b, std::size_t size) noexcept {
+            if (b->size() >= size + header_size + min_payload) {
+                block *rest = reinterpret_cast<block *>(b->payload() + size);
+                rest->m_size = b->size() - size - header_size;
+                rest->m_prev_physical = b;
+                rest->next_physical()->m_prev_physical = rest;
+                b->m_size = size;
+                release(rest);
+            }
+        }
+
+        // return 'b' to the free lists, merged with any free neighbour
+        inline void release(block *b) noexcept {
+            block *prev = b->m_prev_physical;
+            if (prev != nullptr && prev->is_free()) {
+                remove_free(prev);
+                prev->m_size += header_size + b->size();
+                b = prev;
+                b->next_physical()->m_prev_physical = b;
+            }
+            block *next = b->next_physical();
+            if (next->is_free()) {
+                remove_free(next);
+                b->m_size = b->size() + header_size + next->size();
+                b->next_physical()->m_prev_physical = b;
+            }
+            insert_free(b);
+        }
+
+        // a new pool, its single block, at least 'size' bytes, returned in use rather than listed
+        block *add_pool(std::size_t size) {
+            const std::size_t overhead = sizeof(pool) + 2 * header_size;
+            std::size_t live = 0;
+            if (Growth::tracks_demand) {
+                live = m_used;
+            }
+            const std::size_t pool_size = adjust(m_growth.next_size(size + overhead, m_initial_size, live));
+
+            bool mapped;
+            pool *p = static_cast<pool *>(slab_memory::allocate(pool_size, alignof(pool), m_policy, mapped));
+            p->m_next = m_pools;
+            p->m_size = pool_size;
+            p->m_mapped = mapped;
+            m_pools = p;
+            m_reserved += pool_size;
+
+            block *b = reinterpret_cast<block *>(p + 1);
+            b->m_prev_physical = nullptr;
+            b->m_size = pool_size - overhead;
+            block *sentinel = b->next_physical();
+            sentinel->m_prev_physical = b;
+            sentinel->m_size = 0;
+            return b;
+        }
+
+        pointer take(std::size_t size) {
+            std::size_t fl, sl;
+            mapping_search(size, fl, sl);
+            block *b = fl < fl_count ? search_suitable(fl, sl) : nullptr;
+            if (likely(b != nullptr)) {
+                remove_free(b);
+            } else {
+                b = add_pool(size);
+            }
+            split(b, size);
+            m_used += b->size();
+            return b->payload();
+        }
+
+        void give_back(pointer p) noexcept {
+            block *b = block::from_payload(p);
+            assert(!b->is_free());
+            m_used -= b->size();
+            release(b);
+        }
+
+    public:
+        ~tlsf_arena() {
+            while (m_pools != nullptr) {
+                pool *next = m_pools->m_next;
+                slab_memory::deallocate(m_pools, m_pools->m_size, m_pools->m_mapped);
+                m_pools = next;
+            }
+        }
+
+        tlsf_arena(std::size_t initial_size = 64 * 1024, const commit_policy &policy = commit_policy()) : m_initial_size(initial_size), m_policy(policy), m_growth(), m_fl_bitmap(0), m_pools(nullptr), m_reserved(0), m_used(0) {
+            std::memset(m_sl_bitmap, 0, sizeof(m_sl_bitmap));
+            std::memset(m_free, 0, sizeof(m_free));
+            release(add_pool(0));
+        }
+
+        tlsf_arena(const tlsf_arena&) = delete;
+        tlsf_arena& operator=(const tlsf_arena&) = delete;
+
+        tlsf_arena::pointer allocate(std::size_t size) {
+            pointer p;
+            {
+                std::lock_guard<Lock> guard(m_lock);
+                p = take(adjust(size));
+            }
+            allocation_profiler::allocated(this, p, size);
+            return p;
+        }
+
+        // the block's size is in its header, 'size' is only there to match the other arenas
+        void deallocate(tlsf_arena::pointer p, std::size_t) noexcept {
+            allocation_profiler::deallocated(p);
+            std::lock_guard<Lock> guard(m_lock);
+            give_back(p);
+        }
+
+        template <typename P> void allocate_n(std::size_t size, std::size_t count, P *out) {
+            {
+                std::lock_guard<Lock> guard(m_lock);
+                const std::size_t adjusted = adjust(size);
+                for (std::size_t i = 0; i < count; ++i) {
+                    out[i] = reinterpret_cast<P>(take(adjusted));
+                }
+            }
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::allocated(this, out[i], size);
+            }
+        }
+
+        template <typename P> void deallocate_n(const P *ptrs, std::size_t, std::size_t count) noexcept {
+            for (std::size_t i = 0; i < count; ++i) {
+                allocation_profiler::deallocated(ptrs[i]);
+            }
+            std::lock_guard<Lock> guard(m_lock);
+            for (std::size_t i = 0; i < count; ++i) {
+                give_back(reinterpret_cast<pointer>(ptrs[i]));
+            }
+        }
+
+        // grow into a free block that follows, or shrink, without moving
+        bool try_expand(tlsf_arena::pointer p, std::size_t, std::size_t new_size) noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            const std::size_t size = adjust(new_size);
+            block *b = block::from_payload(p);
+            const std::size_t old = b->size();
+            if (size > old) {
+                block *next = b->next_physical();
+                if (!next->is_free() || old + header_size + next->size() < size) {
+                    return false;
+                }
+                remove_free(next);
+                b->m_size = old + header_size + next->size();
+                b->next_physical()->m_prev_physical = b;
+            }
+            split(b, size);
+            m_used = m_used - old + b->size();
+            return true;
+        }
+
+        tlsf_arena::pointer reallocate(tlsf_arena::pointer p, std::size_t old_size, std::size_t new_size) {
+            if (try_expand(p, old_size, new_size)) {
+                return p;
+            }
+            pointer n = allocate(new_size);
+            std::memcpy(n, p, std::min(old_size, new_size));
+            deallocate(p, old_size);
+            return n;
+        }
+
+        // bytes obtained for pools, and the payload bytes of the blocks in use
+        std::size_t reserved_bytes() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            return m_reserved;
+        }
+
+        std::size_t used_bytes() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            return m_used;
+        }
+
+        std::size_t pool_count() const noexcept {
+            std::lock_guard<Lock> guard(m_lock);
+            std::size_t count = 0;
+            for (const pool *p = m_pools; p != nullptr; p = p->m_next) {
+                count++;
+            }
+            return count;
+        }
+
+        friend std::ostream &operator<<(std::ostream &out, const tlsf_arena &a) {
+            std::lock_guard<Lock> guard(a.m_lock);
+            std::size_t pools = 0;
+            std::size_t free_blocks = 0;
+            std::size_t largest_free = 0;
+            for (pool *p = a.m_pools; p != nullptr; p = p->m_next) {
+                pools++;
+                for (block *b = reinterpret_cast<block *>(p + 1); b->size() != 0; b = b->next_physical()) {
+                    if (b->is_free()) {
+                        free_blocks++;
+                        largest_free = std::max(largest_free, b->size());
+                    }
+                }
+            }
+            out << "allocated: " << a.m_used << " capacity: " << a.m_reserved << " free blocks: " << free_blocks << " largest free: " << largest_free << " from " << pools << " pools";
+            return out;
+        }
+    };
+
+    template <typename G, typename L> constexpr std::size_t tlsf_arena<G, L>::header_size;
+    template <typename G, typename L> constexpr std::size_t tlsf_arena<G, L>::min_payload;
+}
+
+#endif //FASTPATH_TLSF_ARENA_H
@@ -0,0 +1,105 @@
+/***************************************************************************
+                          __FILE__
+                          -------------------
+    copyright            : Copyright (c) 2004-2016 Tom Fewster
+    email                : tom@wannabegeek.com
+    date                 : 04/03/2016
+
+ ***************************************************************************/
+
+/***************************************************************************
+ * This library is free software; you can redistribute it and/or           *
+ * modify it under the terms of the GNU Lesser General Public              *
+ * License as published by the Free Software Foundation; either            *
+ * version 2.1 of the License, or (at your option) any later version.      *
+ *                                                                         *
+ * This library is distributed in the hope that it will be useful,         *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU       *
+ * Lesser General Public License for more details.                         *
+ *                                                                         *
+ * You should have received a copy of the GNU Lesser General Public        *
+ * License along with this library; if not, write to the Free Software     *
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA *
+ ***************************************************************************/
+
+#ifndef FASTPATH_ZERO_FILL_H
+#define FASTPATH_ZERO_FILL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace tf {
+
+    // Above this many bytes zero_fill writes around the cache rather than through it.
+    // A block that size would push out most of L2 just to hold zeros, and is rarely
+    // read back in full straight away; below it the block is about to be used and is
+    // better left in cache, where memset puts it.
+    static const std::size_t non_temporal_threshold = 1024 * 1024;
+
+    namespace detail {
+#if defined(__x86_64__)
+        // each streams [p, p + size), p 64 byte aligned and size a multiple of 64
+
+        __attribute__((target("avx512f"))) inline void stream_zero_avx512(unsigned char *p, std::size_t size) noexcept {
+            const __m512i zero = _mm512_setzero_si512();
+            for (unsigned char *end = p + size; p != end; p += 64) {
+                _mm512_stream_si512(reinterpret_cast<__m512i *>(p), zero);
+            }
+        }
+
+        __attribute__((target("avx2"))) inline void stream_zero_avx2(unsigned char *p, std::size_t size) noexcept {
+            const __m256i zero = _mm256_setzero_si256();
+            for (unsigned char *end = p + size; p != end; p += 64) {
+                _mm256_stream_si256(reinterpret_cast<__m256i *>(p), zero);
+                _mm256_stream_si256(reinterpret_cast<__m256i *>(p + 32), zero);
+            }
+        }
+
+        inline void stream_zero_sse2(unsigned char *p, std::size_t size) noexcept {
+            const __m128i zero = _mm_setzero_si128();
+            for (unsigned char *end = p + size; p != end; p += 64) {
+                _mm_stream_si128(reinterpret_cast<__m128i *>(p), zero);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(p + 16), zero);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(p + 32), zero);
+                _mm_stream_si128(reinterpret_cast<__m128i *>(p + 48), zero);
+            }
+        }
+
+        using stream_zero_function = void (*)(unsigned char *, std::size_t);
+
+        // the widest stores this CPU has, looked up once
+        inline stream_zero_function stream_zero() noexcept {
+            static const stream_zero_function f = __builtin_cpu_supports("avx512f") ? stream_zero_avx512 : __builtin_cpu_supports("avx2") ? stream_zero_avx2 : stream_zero_sse2;
+            return f;
+        }
+#endif
+    }
+
+    // Zero 'size' bytes at 'p': with memset up to 'threshold' bytes, and beyond it with
+    // non-temporal stores as wide as the CPU supports, which do not read the lines
+    // they overwrite into the cache or evict anything to make room for them.
+    inline void zero_fill(void *p, std::size_t size, std::size_t threshold = non_temporal_threshold) noexcept {
+#if defined(__x86_64__)
+        if (size >= threshold && size >= 128) {
+            unsigned char *b = static_cast<unsigned char *>(p);
+            unsigned char *body = reinterpret_cast<unsigned char *>((reinterpret_cast<std::uintptr_t>(b) + 63) & ~std::uintptr_t(63));
+            unsigned char *tail = reinterpret_cast<unsigned char *>(reinterpret_cast<std::uintptr_t>(b + size) & ~std::uintptr_t(63));
+            std::memset(b, 0, static_cast<std::size_t>(body - b));
+            detail::stream_zero()(body, static_cast<std::size_t>(tail - body));
+            std::memset(tail, 0, static_cast<std::size_t>(b + size - tail));
+            // order the streaming stores before anything the caller writes next
+            _mm_sfence();
+            return;
+        }
+#endif
+        (void)threshold;
+        std::memset(p, 0, size);
+    }
+}
+
+#endif //FASTPATH_ZERO_FILL_H